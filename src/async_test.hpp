@@ -0,0 +1,491 @@
+#ifndef ASYNC_TEST_HPP
+#define ASYNC_TEST_HPP
+
+#include "test_fwd.hpp"
+
+#include "../../cpplib/src/stop_watch.hpp"
+
+#include <chrono>
+#include <coroutine>
+#include <exception>
+#include <map>
+#include <optional>
+#include <stdexcept>
+#include <system_error>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#ifdef __linux__
+    #include <cerrno>
+    #include <sys/epoll.h>
+    #include <sys/syscall.h>
+    #include <sys/types.h>
+    #include <sys/wait.h>
+    #include <unistd.h>
+#endif
+
+namespace pensar_digital
+{
+    namespace unit_test
+    {
+        template <typename T = void>
+        class Async;
+
+        namespace detail
+        {
+            struct AsyncPromiseBase
+            {
+                /// Coroutine to resume when this one finishes: the awaiter, if any.
+                std::coroutine_handle<> continuation;
+                std::exception_ptr error;
+
+                struct Final
+                {
+                    bool await_ready () noexcept { return false; }
+
+                    template <typename P>
+                    std::coroutine_handle<> await_suspend (std::coroutine_handle<P> h) noexcept
+                    {
+                        std::coroutine_handle<> next = h.promise ().continuation;
+                        return next ? next : std::noop_coroutine ();
+                    }
+
+                    void await_resume () noexcept {}
+                };
+
+                std::suspend_always initial_suspend () noexcept { return {}; }
+                Final final_suspend () noexcept { return {}; }
+                void unhandled_exception () { error = std::current_exception (); }
+            };
+
+            template <typename T>
+            struct AsyncPromise : AsyncPromiseBase
+            {
+                std::optional<T> value;
+
+                Async<T> get_return_object ();
+                void return_value (T v) { value = std::move (v); }
+            };
+
+            template <>
+            struct AsyncPromise<void> : AsyncPromiseBase
+            {
+                Async<void> get_return_object ();
+                void return_void () {}
+            };
+        }  // namespace detail
+
+        /// Coroutine type of ASYNC_TEST bodies and of the helpers they co_await. It starts suspended,
+        /// runs when awaited, and hands its result or exception (a Failure included) to the awaiter.
+        template <typename T>
+        class Async
+        {
+            public:
+            typedef detail::AsyncPromise<T> promise_type;
+            typedef std::coroutine_handle<promise_type> Handle;
+
+            explicit Async (Handle h) : handle (h) {}
+            Async (Async&& other) noexcept : handle (std::exchange (other.handle, {})) {}
+            Async (const Async&) = delete;
+            Async& operator= (const Async&) = delete;
+            Async& operator= (Async&&) = delete;
+            ~Async () { if (handle) handle.destroy (); }
+
+            bool await_ready () const noexcept { return false; }
+
+            std::coroutine_handle<> await_suspend (std::coroutine_handle<> awaiter) noexcept
+            {
+                handle.promise ().continuation = awaiter;
+                return handle;
+            }
+
+            T await_resume ()
+            {
+                if (handle.promise ().error)
+                    std::rethrow_exception (handle.promise ().error);
+                if constexpr (!std::is_void_v<T>)
+                    return std::move (*handle.promise ().value);
+            }
+
+            Handle get_handle () const { return handle; }
+
+            private:
+            Handle handle;
+        };
+
+        template <typename T>
+        Async<T> detail::AsyncPromise<T>::get_return_object () { return Async<T> (Async<T>::Handle::from_promise (*this)); }
+
+        inline Async<void> detail::AsyncPromise<void>::get_return_object () { return Async<void> (Async<void>::Handle::from_promise (*this)); }
+
+        class AsyncTest;
+
+        /// Single-threaded scheduler of asynchronous tests. run () keeps up to max_in_flight tests
+        /// started at once; each runs until it co_awaits a timer or an fd, and the loop resumes it when
+        /// that is due (epoll on Linux; elsewhere only timers are available). A test still running
+        /// at its deadline is destroyed and fails as timed out. The output of whichever test is
+        /// running goes to its own result, as with the other runners.
+        class EventLoop
+        {
+            public:
+            typedef std::chrono::steady_clock Clock;
+
+            static constexpr size_t DEFAULT_MAX_IN_FLIGHT = 1024;
+
+            EventLoop ()
+            {
+                #ifdef __linux__
+                    epoll = epoll_create1 (EPOLL_CLOEXEC);
+                    if (epoll < 0)
+                        throw std::system_error (errno, std::generic_category (), "epoll_create1");
+                #endif
+            }
+
+            EventLoop (const EventLoop&) = delete;
+            EventLoop& operator= (const EventLoop&) = delete;
+
+            ~EventLoop ()
+            {
+                #ifdef __linux__
+                    ::close (epoll);
+                #endif
+            }
+
+            /// The loop running the calling coroutine.
+            static EventLoop& current ()
+            {
+                if (running == nullptr || running->resuming == nullptr)
+                    throw std::logic_error ("Only ASYNC_TEST bodies can wait on the event loop.");
+                return *running;
+            }
+
+            /// Resumes h at when. Called by the awaitables.
+            void wait_until (Clock::time_point when, std::coroutine_handle<> h)
+            {
+                Slot& s = *resuming;
+                s.waiting = h;
+                s.wait    = Slot::TIMER;
+                s.timer   = timers.emplace (when, &s);
+            }
+
+            /// Resumes h when fd is ready for events (EPOLLIN / EPOLLOUT). One waiter per fd at a time.
+            void wait_fd (int fd, uint32_t events, std::coroutine_handle<> h)
+            {
+                #ifdef __linux__
+                    Slot& s = *resuming;
+                    epoll_event e = {};
+                    e.events   = events;
+                    e.data.ptr = &s;
+                    if (epoll_ctl (epoll, EPOLL_CTL_ADD, fd, &e) != 0)
+                        throw std::system_error (errno, std::generic_category (), "epoll_ctl");
+                    s.waiting = h;
+                    s.wait    = Slot::FD;
+                    s.fd      = fd;
+                #else
+                    (void) fd; (void) events; (void) h;
+                    throw std::logic_error ("Waiting on file descriptors needs epoll (Linux).");
+                #endif
+            }
+
+            /// Runs tests, each with its outcome written to *results[i], which must provide ran, ok,
+            /// nanoseconds, elapsed and output like TestResult. With stop_on_failure the first failure
+            /// cancels the tests still running or not started; they are left with ran = false.
+            template <typename Result>
+            void run (const std::vector<AsyncTest*>& tests, const std::vector<Result*>& results, bool stop_on_failure,
+                      size_t max_in_flight = DEFAULT_MAX_IN_FLIGHT);
+
+            private:
+            struct Slot
+            {
+                enum Wait { NONE, TIMER, FD };
+
+                AsyncTest* test = nullptr;
+                size_t index = 0;
+                bool active = false;
+                std::optional<Async<bool>> task;
+                std::coroutine_handle<> waiting;
+                Wait wait = NONE;
+                std::multimap<Clock::time_point, Slot*>::iterator timer;
+                int fd = -1;
+                Clock::time_point started;
+                Clock::time_point deadline;
+                StopWatch<> sw;
+            };
+
+            /// Drops the wait s is registered for, if any.
+            void unwait (Slot& s)
+            {
+                if (s.wait == Slot::TIMER)
+                    timers.erase (s.timer);
+                #ifdef __linux__
+                    else if (s.wait == Slot::FD)
+                        epoll_ctl (epoll, EPOLL_CTL_DEL, s.fd, nullptr);
+                #endif
+                s.wait = Slot::NONE;
+            }
+
+            /// Blocks until the next fd event, timer or deadline and returns the slots whose fd is ready.
+            void poll (Clock::time_point until, std::vector<Slot*>& ready)
+            {
+                if (!timers.empty () && timers.begin ()->first < until)
+                    until = timers.begin ()->first;
+                Clock::time_point now = Clock::now ();
+                int timeout_ms = until <= now ? 0 : static_cast<int> (std::min<int64_t> (
+                    std::chrono::duration_cast<std::chrono::milliseconds> (until - now).count () + 1, 60000));
+                #ifdef __linux__
+                    epoll_event events[64];
+                    int n = epoll_wait (epoll, events, 64, timeout_ms);
+                    for (int i = 0; i < n; ++i)
+                        ready.push_back (static_cast<Slot*> (events[i].data.ptr));
+                #else
+                    std::this_thread::sleep_for (std::chrono::milliseconds (timeout_ms));
+                #endif
+            }
+
+            inline static thread_local EventLoop* running = nullptr;
+
+            #ifdef __linux__
+            int epoll = -1;
+            #endif
+            Slot* resuming = nullptr;
+            std::multimap<Clock::time_point, Slot*> timers;
+        };
+
+        /// Awaitable resuming the caller after a delay.
+        struct SleepFor
+        {
+            EventLoop::Clock::duration delay;
+
+            bool await_ready () const { return delay <= EventLoop::Clock::duration::zero (); }
+            void await_suspend (std::coroutine_handle<> h) { EventLoop::current ().wait_until (EventLoop::Clock::now () + delay, h); }
+            void await_resume () const {}
+        };
+
+        inline SleepFor sleep_for (EventLoop::Clock::duration delay) { return SleepFor { delay }; }
+
+        #ifdef __linux__
+        /// Awaitable resuming the caller when fd is ready for events.
+        struct FdReady
+        {
+            int fd;
+            uint32_t events;
+
+            bool await_ready () const { return false; }
+            void await_suspend (std::coroutine_handle<> h) { EventLoop::current ().wait_fd (fd, events, h); }
+            void await_resume () const {}
+        };
+
+        inline FdReady readable (int fd) { return FdReady { fd, EPOLLIN }; }
+        inline FdReady writable (int fd) { return FdReady { fd, EPOLLOUT }; }
+
+        #ifdef SYS_pidfd_open
+        /// Awaitable resuming the caller when child process pid exits. Reaps it and returns its waitpid status.
+        class ProcessExit
+        {
+            public:
+            explicit ProcessExit (pid_t apid) : pid (apid), fd (static_cast<int> (syscall (SYS_pidfd_open, apid, 0)))
+            {
+                if (fd < 0)
+                    throw std::system_error (errno, std::generic_category (), "pidfd_open");
+            }
+
+            ProcessExit (const ProcessExit&) = delete;
+            ~ProcessExit () { ::close (fd); }
+
+            bool await_ready () const { return false; }
+            void await_suspend (std::coroutine_handle<> h) { EventLoop::current ().wait_fd (fd, EPOLLIN, h); }
+
+            int await_resume () const
+            {
+                int status = 0;
+                while (waitpid (pid, &status, 0) < 0 && errno == EINTR) {}
+                return status;
+            }
+
+            private:
+            pid_t pid;
+            int fd;
+        };
+
+        inline ProcessExit exited (pid_t pid) { return ProcessExit (pid); }
+        #endif
+        #endif
+
+        /// AsyncTest is a Test whose body is a coroutine, run_async (). Within a CompositeTest run the
+        /// asynchronous tests with no ordering constraint share one EventLoop; run () runs the test
+        /// alone on a loop of its own. The timeout may be changed from the body, before its first wait.
+        class AsyncTest : public Test
+        {
+            public:
+            inline static std::chrono::milliseconds DEFAULT_TIMEOUT = std::chrono::seconds (10);
+
+            AsyncTest (const S& name, const std::source_location& where = std::source_location::current ()) :
+                Test (name, NULL_ID, UNORDERED, true, true, where) {}
+
+            virtual Async<bool> run_async () = 0;
+
+            AsyncTest& set_timeout (std::chrono::milliseconds t) { timeout = t; return *this; }
+            std::chrono::milliseconds get_timeout () const { return timeout; }
+
+            bool run ()
+            {
+                struct Outcome
+                {
+                    bool    ran = false;
+                    bool    ok  = true;
+                    int64_t nanoseconds = 0;
+                    S       elapsed;
+                    SStream output;
+                } outcome;
+                EventLoop loop;
+                loop.run (std::vector<AsyncTest*> { this }, std::vector<Outcome*> { &outcome }, get_stop_on_failure ());
+                test_out () << outcome.output.str ();
+                return outcome.ok;
+            }
+
+            private:
+            std::chrono::milliseconds timeout = DEFAULT_TIMEOUT;
+        };
+
+        template <typename Result>
+        void EventLoop::run (const std::vector<AsyncTest*>& tests, const std::vector<Result*>& results, bool stop_on_failure, size_t max_in_flight)
+        {
+            EventLoop* const outer_loop = std::exchange (running, this);
+            std::basic_ostream<C>* const outer_stream = test_stream;
+            std::vector<Slot> slots (tests.size ());
+            size_t next = 0;
+            size_t in_flight = 0;
+            bool cancelled = false;
+
+            auto finish = [&](Slot& s, bool timed_out)
+            {
+                Result& r = *results[s.index];
+                unwait (s);
+                test_stream = &r.output;
+                if (timed_out)
+                {
+                    r.ok = false;
+                    r.output << s.test->get_name () << W(" timed out after ") << s.test->get_timeout ().count () << W(" ms.") << std::endl;
+                }
+                else
+                {
+                    try
+                    {
+                        r.ok = s.task->await_resume ();
+                    }
+                    catch (const Failure& f)
+                    {
+                        r.ok = false;
+                        r.output << f.get_error_message () << std::endl;
+                    }
+                    catch (const std::exception& e)
+                    {
+                        r.ok = false;
+                        r.output << s.test->get_name () << W(" threw an unexpected exception: ") << e.what () << std::endl;
+                    }
+                    catch (...)
+                    {
+                        r.ok = false;
+                        r.output << s.test->get_name () << W(" threw an unexpected exception.") << std::endl;
+                    }
+                }
+                s.task.reset ();
+                test_stream = outer_stream;
+                r.nanoseconds = std::chrono::duration_cast<std::chrono::nanoseconds> (Clock::now () - s.started).count ();
+                r.elapsed = s.sw.elapsed_since_mark_formatted ();
+                if (s.active)
+                    --in_flight;
+                s.active = false;
+                if (!r.ok && stop_on_failure)
+                    cancelled = true;
+            };
+
+            auto resume = [&](Slot& s, std::coroutine_handle<> h)
+            {
+                resuming = &s;
+                test_stream = &results[s.index]->output;
+                h.resume ();
+                test_stream = outer_stream;
+                resuming = nullptr;
+                if (s.task->get_handle ().done ())
+                    finish (s, false);
+            };
+
+            std::vector<Slot*> ready;
+            for (;;)
+            {
+                for (; !cancelled && next < tests.size () && in_flight < max_in_flight; ++next)
+                {
+                    Slot& s = slots[next];
+                    s.test  = tests[next];
+                    s.index = next;
+                    s.test->set_stop_on_failure (stop_on_failure);
+                    results[next]->ran = true;
+                    s.started = Clock::now ();
+                    s.sw.mark ();
+                    s.task.emplace (s.test->run_async ());
+                    s.active = true;
+                    ++in_flight;
+                    resume (s, s.task->get_handle ());
+                    if (s.active)
+                        s.deadline = s.started + s.test->get_timeout ();
+                }
+                if (cancelled)
+                    for (Slot& s : slots)
+                        if (s.active)
+                        {
+                            unwait (s);
+                            s.task.reset ();
+                            s.active = false;
+                            results[s.index]->ran = false;
+                            --in_flight;
+                        }
+                if (in_flight == 0 && (cancelled || next == tests.size ()))
+                    break;
+
+                Clock::time_point until = Clock::time_point::max ();
+                for (Slot& s : slots)
+                    if (s.active && s.deadline < until)
+                        until = s.deadline;
+                ready.clear ();
+                poll (until, ready);
+                for (Slot* s : ready)
+                    if (s->active && s->wait == Slot::FD)
+                    {
+                        unwait (*s);
+                        resume (*s, s->waiting);
+                    }
+                for (Clock::time_point now = Clock::now (); !timers.empty () && timers.begin ()->first <= now; )
+                {
+                    Slot& s = *timers.begin ()->second;
+                    unwait (s);
+                    resume (s, s.waiting);
+                }
+                for (Clock::time_point now = Clock::now (); Slot& s : slots)
+                    if (s.active && s.deadline <= now)
+                        finish (s, true);
+            }
+            running = outer_loop;
+        }
+
+        /// ASYNC_TEST(name, is_enabled) { body } ASYNC_TEST_END(name) declares an AsyncTest. The body is a
+        /// coroutine: it may co_await sleep_for (), readable (fd), writable (fd), exited (pid) and other
+        /// Async functions, and use the CHECK macros as in TEST.
+        #define ASYNC_TEST(name, is_enabled) \
+                      class Test##name : public AsyncTest          \
+                      {                                            \
+                        public:                                    \
+                        inline static const Version VERSION = Version (1, 1, 1); \
+                        Test##name ()                              \
+                        : AsyncTest (W(#name)){is_enabled ? enable () : disable ();enlist ();};         \
+                        Async<bool> run_async ()                   \
+                        {
+
+        #define ASYNC_TEST_END(name)                                     \
+                        co_return true; }                          \
+                      }; Test ## name test_ ## name;
+    }  // namespace unit_test
+}  // namespace pensar_digital
+
+#endif // ASYNC_TEST_HPP
@@ -0,0 +1,263 @@
+#ifndef BENCHMARK_HPP
+#define BENCHMARK_HPP
+
+#include "test_fwd.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <iomanip>
+#include <vector>
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+    #define UNIT_TEST_HAS_TSC 1
+    #ifdef _MSC_VER
+        #include <intrin.h>
+    #else
+        #include <x86intrin.h>
+    #endif
+#endif
+
+namespace pensar_digital
+{
+    namespace unit_test
+    {
+        /// Keeps the compiler from discarding value or the computation that produced it.
+        template <typename T>
+        inline void do_not_optimize (T const& value)
+        {
+            #if defined(__GNUC__) || defined(__clang__)
+                asm volatile ("" : : "r,m" (value) : "memory");
+            #else
+                const volatile char* p = reinterpret_cast<const volatile char*> (&value);
+                (void) *p;
+                std::atomic_signal_fence (std::memory_order_seq_cst);
+            #endif
+        }
+
+        /// Forces pending writes to memory to be treated as observable.
+        inline void clobber_memory ()
+        {
+            #if defined(__GNUC__) || defined(__clang__)
+                asm volatile ("" : : : "memory");
+            #else
+                std::atomic_signal_fence (std::memory_order_seq_cst);
+            #endif
+        }
+
+        /// Time source used to measure benchmark samples.
+        enum class BenchmarkClock
+        {
+            STEADY, ///< std::chrono::steady_clock.
+            TSC     ///< The time stamp counter, calibrated against steady_clock. Falls back to STEADY off x86.
+        };
+
+        /// Reads the selected clock in nanoseconds.
+        class BenchmarkTimer
+        {
+            public:
+            explicit BenchmarkTimer (BenchmarkClock c = BenchmarkClock::STEADY) : clock (c)
+            {
+                #ifndef UNIT_TEST_HAS_TSC
+                    clock = BenchmarkClock::STEADY;
+                #endif
+            }
+
+            double now () const
+            {
+                #ifdef UNIT_TEST_HAS_TSC
+                    if (clock == BenchmarkClock::TSC)
+                        return static_cast<double> (__rdtsc ()) / ticks_per_ns ();
+                #endif
+                return static_cast<double> (std::chrono::duration_cast<std::chrono::nanoseconds> (
+                    std::chrono::steady_clock::now ().time_since_epoch ()).count ());
+            }
+
+            BenchmarkClock get_clock () const { return clock; }
+
+            private:
+            #ifdef UNIT_TEST_HAS_TSC
+            /// TSC ticks per nanosecond, measured once over 20 ms of steady_clock time.
+            static double ticks_per_ns ()
+            {
+                static const double ratio = []()
+                {
+                    auto t0 = std::chrono::steady_clock::now ();
+                    uint64_t c0 = __rdtsc ();
+                    while (std::chrono::steady_clock::now () - t0 < std::chrono::milliseconds (20)) {}
+                    uint64_t c1 = __rdtsc ();
+                    auto t1 = std::chrono::steady_clock::now ();
+                    double ns = static_cast<double> (std::chrono::duration_cast<std::chrono::nanoseconds> (t1 - t0).count ());
+                    return static_cast<double> (c1 - c0) / ns;
+                }();
+                return ratio;
+            }
+            #endif
+
+            BenchmarkClock clock;
+        };
+
+        /// Summary of the per-operation times of a benchmark's samples, in nanoseconds.
+        struct BenchmarkStats
+        {
+            double min     = 0;
+            double median  = 0;
+            double mean    = 0;
+            double stddev  = 0;
+            double p99     = 0;
+
+            /// \param samples Nanoseconds per operation of each sample. Sorted in place.
+            static BenchmarkStats of (std::vector<double>& samples)
+            {
+                BenchmarkStats s;
+                if (samples.empty ())
+                    return s;
+                std::sort (samples.begin (), samples.end ());
+                size_t n = samples.size ();
+                s.min    = samples.front ();
+                s.median = n % 2 ? samples[n / 2] : (samples[n / 2 - 1] + samples[n / 2]) / 2;
+                s.p99    = samples[std::min (n - 1, static_cast<size_t> (std::ceil (0.99 * n)) - 1)];
+                for (double x : samples)
+                    s.mean += x;
+                s.mean /= n;
+                for (double x : samples)
+                    s.stddev += (x - s.mean) * (x - s.mean);
+                s.stddev = n > 1 ? std::sqrt (s.stddev / (n - 1)) : 0;
+                return s;
+            }
+        };
+
+        /// Benchmark is a Test that measures the time per operation of iterate ().
+        /// run () first warms up, then grows the iteration count until one sample takes
+        /// target_time / samples, then collects samples and prints their statistics.
+        class Benchmark : public Test
+        {
+            public:
+            inline static std::chrono::nanoseconds DEFAULT_WARMUP      = std::chrono::milliseconds (100);
+            inline static std::chrono::nanoseconds DEFAULT_TARGET_TIME = std::chrono::seconds (1);
+            inline static size_t                   DEFAULT_SAMPLES     = 50;
+            inline static BenchmarkClock           DEFAULT_CLOCK       = BenchmarkClock::STEADY;
+
+            Benchmark (const S& name, const std::source_location& where = std::source_location::current ()) :
+                Test (name, NULL_ID, UNORDERED, true, true, where) {}
+
+            /// Runs the operation being measured iterations times.
+            virtual void iterate (size_t iterations) = 0;
+
+            Benchmark& set_warmup      (std::chrono::nanoseconds t) { warmup      = t; return *this; }
+            Benchmark& set_target_time (std::chrono::nanoseconds t) { target_time = t; return *this; }
+            Benchmark& set_samples     (size_t n                  ) { samples     = n == 0 ? 1 : n; return *this; }
+            Benchmark& set_clock       (BenchmarkClock c          ) { clock       = c; return *this; }
+
+            /// Throughput units processed by one iteration. Reported per second when not zero.
+            Benchmark& set_bytes_per_iteration (uint64_t n) { bytes_per_iteration = n; return *this; }
+            Benchmark& set_items_per_iteration (uint64_t n) { items_per_iteration = n; return *this; }
+
+            const BenchmarkStats& get_stats () const { return stats; }
+            size_t get_iterations () const { return iterations; }
+
+            bool run ()
+            {
+                BenchmarkTimer timer (clock);
+                const double sample_ns = static_cast<double> (target_time.count ()) / samples;
+
+                for (double start = timer.now (); timer.now () - start < warmup.count (); )
+                    iterate (1);
+
+                iterations = 1;
+                for (;;)
+                {
+                    double elapsed = time (timer, iterations);
+                    if (elapsed >= sample_ns || iterations >= MAX_ITERATIONS)
+                        break;
+                    double growth = elapsed <= 0 ? 10 : std::min (10.0, std::max (2.0, 1.2 * sample_ns / elapsed));
+                    iterations = std::min (MAX_ITERATIONS, static_cast<size_t> (iterations * growth));
+                }
+
+                std::vector<double> ns_per_op;
+                ns_per_op.reserve (samples);
+                for (size_t i = 0; i < samples; ++i)
+                    ns_per_op.push_back (time (timer, iterations) / iterations);
+                stats = BenchmarkStats::of (ns_per_op);
+                report ();
+                return true;
+            }
+
+            private:
+            static constexpr size_t MAX_ITERATIONS = size_t (1) << 40;
+
+            double time (const BenchmarkTimer& timer, size_t n)
+            {
+                clobber_memory ();
+                double start = timer.now ();
+                iterate (n);
+                clobber_memory ();
+                return timer.now () - start;
+            }
+
+            static S rate (double per_second, const C* unit)
+            {
+                static const C* prefixes[] = { W(""), W("k"), W("M"), W("G"), W("T") };
+                size_t p = 0;
+                for (; per_second >= 1000 && p < 4; ++p)
+                    per_second /= 1000;
+                SStream ss;
+                ss << std::fixed << std::setprecision (2) << per_second << W(" ") << prefixes[p] << unit << W("/s");
+                return ss.str ();
+            }
+
+            void report () const
+            {
+                std::basic_ostream<C>& os = test_out ();
+                const std::ios_base::fmtflags flags = os.flags ();
+                const std::streamsize precision = os.precision ();
+                os << std::fixed << std::setprecision (2)
+                   << get_name () << W("\t") << samples << W(" x ") << iterations << W(" iterations")
+                   << W("\tmin ")    << stats.min
+                   << W("\tmedian ") << stats.median
+                   << W("\tmean ")   << stats.mean
+                   << W("\tstddev ") << stats.stddev
+                   << W("\tp99 ")    << stats.p99 << W(" ns/op");
+                if (bytes_per_iteration != 0 && stats.mean > 0)
+                    os << W("\t") << rate (bytes_per_iteration * 1e9 / stats.mean, W("B"));
+                if (items_per_iteration != 0 && stats.mean > 0)
+                    os << W("\t") << rate (items_per_iteration * 1e9 / stats.mean, W("items"));
+                os << std::endl;
+                os.flags (flags);
+                os.precision (precision);
+            }
+
+            std::chrono::nanoseconds warmup      = DEFAULT_WARMUP;
+            std::chrono::nanoseconds target_time = DEFAULT_TARGET_TIME;
+            size_t                   samples     = DEFAULT_SAMPLES;
+            BenchmarkClock           clock       = DEFAULT_CLOCK;
+            uint64_t bytes_per_iteration = 0;
+            uint64_t items_per_iteration = 0;
+            size_t iterations = 0;
+            BenchmarkStats stats;
+        };
+
+        /// Declares a benchmark whose body, up to BENCHMARK_END, is one iteration of the operation
+        /// being measured. The body may call set_bytes_per_iteration / set_items_per_iteration.
+        #define BENCHMARK(name)                                                           \
+                      class Benchmark##name : public Benchmark                              \
+                      {                                                                   \
+                        public:                                                           \
+                        inline static const Version VERSION = Version (1, 1, 1);          \
+                        Benchmark##name ()                                                \
+                        : Benchmark (W(#name)){enlist ();};                                \
+                        void iterate (size_t iterations)                                  \
+                        {                                                                 \
+                          for (size_t iteration = 0; iteration < iterations; ++iteration) \
+                          {
+
+        #define BENCHMARK_END(name)                                                       \
+                          }                                                               \
+                        }                                                                 \
+                      }; Benchmark ## name benchmark_ ## name;
+    }  // namespace unit_test
+}  // namespace pensar_digital
+
+#endif // BENCHMARK_HPP
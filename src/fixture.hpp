@@ -0,0 +1,158 @@
+#ifndef FIXTURE_HPP
+#define FIXTURE_HPP
+
+#include "test_fwd.hpp"
+
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <utility>
+
+namespace pensar_digital
+{
+    namespace unit_test
+    {
+        /// FixtureBase is expensive state shared by the tests that declare it, with Test::uses () or
+        /// TEST_WITH, or by every test of a CompositeTest that uses it. It is set up lazily, by the runner
+        /// right before the first dependent test or by the first get () from a test body, and torn down
+        /// by the runner once the last dependent test of the run has finished, or at the end of the run.
+        /// Set-up time is kept out of the tests' times and reported on its own.
+        class FixtureBase
+        {
+            public:
+            explicit FixtureBase (const S& aname) : name (aname) {}
+            FixtureBase (const FixtureBase&) = delete;
+            FixtureBase& operator= (const FixtureBase&) = delete;
+            virtual ~FixtureBase () {}
+
+            const S& get_name () const { return name; }
+            bool is_ready () const { return ready.load (std::memory_order_acquire); }
+
+            /// Sets the fixture up unless it is up. Thread safe: concurrent callers wait for the first.
+            /// A failed set-up is remembered until the fixture is disposed, so dependents fail fast.
+            void ensure ()
+            {
+                if (ready.load (std::memory_order_acquire)) [[likely]]
+                    return;
+                std::lock_guard<std::mutex> lock (mutex);
+                if (ready.load (std::memory_order_relaxed))
+                    return;
+                if (!error.empty ())
+                    throw std::runtime_error (error);
+                const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now ();
+                try
+                {
+                    set_up ();
+                }
+                catch (const std::exception& e)
+                {
+                    error = std::string ("fixture set-up failed: ") + e.what ();
+                    throw std::runtime_error (error);
+                }
+                catch (...)
+                {
+                    error = "fixture set-up failed.";
+                    throw std::runtime_error (error);
+                }
+                setup_nanoseconds += std::chrono::duration_cast<std::chrono::nanoseconds> (std::chrono::steady_clock::now () - start).count ();
+                ++setups;
+                ready.store (true, std::memory_order_release);
+            }
+
+            /// Tears the fixture down if it is up and forgets a failed set-up.
+            void dispose ()
+            {
+                std::lock_guard<std::mutex> lock (mutex);
+                error.clear ();
+                if (!ready.load (std::memory_order_relaxed))
+                    return;
+                ready.store (false, std::memory_order_relaxed);
+                tear_down ();
+            }
+
+            /// Runner bookkeeping: expect (n) announces n more dependent tests for the current run;
+            /// release () is called as each finishes and disposes the fixture after the last one.
+            void expect (size_t n) { dependents.fetch_add (n, std::memory_order_relaxed); }
+
+            void release ()
+            {
+                if (dependents.fetch_sub (1, std::memory_order_acq_rel) == 1)
+                    dispose ();
+            }
+
+            /// Set-up count and time since the last call. The runner reports them once per run.
+            std::pair<size_t, int64_t> take_setup_stats ()
+            {
+                std::lock_guard<std::mutex> lock (mutex);
+                dependents.store (0, std::memory_order_relaxed);
+                return { std::exchange (setups, 0), std::exchange (setup_nanoseconds, 0) };
+            }
+
+            protected:
+            virtual void set_up    () = 0;
+            virtual void tear_down () = 0;
+
+            private:
+            S name;
+            std::mutex mutex;
+            std::atomic<bool> ready = false;
+            std::atomic<size_t> dependents = 0;
+            std::string error;
+            size_t setups = 0;
+            int64_t setup_nanoseconds = 0;
+        };
+
+        /// Private, writable view of a shared value: reads go to the shared value until the first
+        /// write, which copies it.
+        template <typename T>
+        class CopyOnWrite
+        {
+            public:
+            explicit CopyOnWrite (std::shared_ptr<const T> avalue) : shared (std::move (avalue)) {}
+
+            const T& operator*  () const { return own ? *own : *shared; }
+            const T* operator-> () const { return &**this; }
+
+            T& write ()
+            {
+                if (!own)
+                    own = std::make_unique<T> (*shared);
+                return *own;
+            }
+
+            private:
+            std::shared_ptr<const T> shared;
+            std::unique_ptr<T> own;
+        };
+
+        /// A fixture holding the T its factory builds. Tests read it through get () or share (), or
+        /// take a CopyOnWrite view to modify their own copy. Tear-down destroys the value once the
+        /// last share () handle is gone, so a temporary directory type cleans up in its destructor.
+        template <typename T>
+        class Fixture : public FixtureBase
+        {
+            public:
+            typedef std::function<T ()> Factory;
+
+            Fixture (const S& name, Factory afactory) : FixtureBase (name), factory (std::move (afactory)) {}
+
+            const T& get () { ensure (); return *value; }
+            std::shared_ptr<const T> share () { ensure (); return value; }
+            CopyOnWrite<T> copy_on_write () { return CopyOnWrite<T> (share ()); }
+
+            protected:
+            void set_up    () { value = std::make_shared<const T> (factory ()); }
+            void tear_down () { value.reset (); }
+
+            private:
+            Factory factory;
+            std::shared_ptr<const T> value;
+        };
+    }  // namespace unit_test
+}  // namespace pensar_digital
+
+#endif // FIXTURE_HPP
@@ -0,0 +1,210 @@
+#ifndef GOLDEN_HPP
+#define GOLDEN_HPP
+
+#include "range_compare.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <span>
+#include <stdexcept>
+#include <string>
+#include <system_error>
+
+#ifdef _WIN32
+    #ifndef WIN32_LEAN_AND_MEAN
+        #define WIN32_LEAN_AND_MEAN     // Keeps winsock.h out, so winsock2.h can still be included.
+    #endif
+    #ifndef NOMINMAX
+        #define NOMINMAX
+    #endif
+    #include <windows.h>
+#else
+    #include <cerrno>
+    #include <fcntl.h>
+    #include <sys/mman.h>
+    #include <sys/stat.h>
+    #include <unistd.h>
+#endif
+
+/// Golden-file (snapshot) comparison for large outputs, used by CHECK_MATCHES_GOLDEN.
+///
+/// The golden file is memory-mapped and compared against the actual bytes in place, a chunk at a
+/// time; pages already compared are dropped from the mapping, so neither side is copied and the
+/// golden file never has to be resident as a whole. With update mode on (--update-golden), a
+/// golden file that is missing or differs is replaced instead: the bytes go to a temporary file
+/// next to it, which is flushed and renamed over the old one, so readers never see a partial file.
+namespace pensar_digital
+{
+    namespace unit_test
+    {
+        /// Read-only mapping of a whole file. An empty file maps to an empty span.
+        class MappedFile
+        {
+            public:
+            explicit MappedFile (const std::filesystem::path& path)
+            {
+                #ifdef _WIN32
+                    file = CreateFileW (path.c_str (), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_DELETE, nullptr, OPEN_EXISTING,
+                                        FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+                    if (file == INVALID_HANDLE_VALUE)
+                        throw std::system_error (static_cast<int> (GetLastError ()), std::system_category (), "CreateFile");
+                    LARGE_INTEGER n;
+                    GetFileSizeEx (file, &n);
+                    length = static_cast<size_t> (n.QuadPart);
+                    if (length == 0)
+                        return;
+                    mapping = CreateFileMappingW (file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+                    if (mapping == nullptr || (data = static_cast<const std::byte*> (MapViewOfFile (mapping, FILE_MAP_READ, 0, 0, 0))) == nullptr)
+                    {
+                        int e = static_cast<int> (GetLastError ());
+                        close ();
+                        throw std::system_error (e, std::system_category (), "MapViewOfFile");
+                    }
+                #else
+                    fd = ::open (path.c_str (), O_RDONLY | O_CLOEXEC);
+                    if (fd < 0)
+                        throw std::system_error (errno, std::generic_category (), "open");
+                    struct stat st;
+                    if (fstat (fd, &st) != 0)
+                    {
+                        int e = errno;
+                        close ();
+                        throw std::system_error (e, std::generic_category (), "fstat");
+                    }
+                    length = static_cast<size_t> (st.st_size);
+                    if (length == 0)
+                        return;
+                    void* p = mmap (nullptr, length, PROT_READ, MAP_PRIVATE, fd, 0);
+                    if (p == MAP_FAILED)
+                    {
+                        int e = errno;
+                        close ();
+                        throw std::system_error (e, std::generic_category (), "mmap");
+                    }
+                    data = static_cast<const std::byte*> (p);
+                    madvise (p, length, MADV_SEQUENTIAL);
+                #endif
+            }
+
+            MappedFile (const MappedFile&) = delete;
+            MappedFile& operator= (const MappedFile&) = delete;
+            ~MappedFile () { close (); }
+
+            std::span<const std::byte> bytes () const { return { data, length }; }
+            size_t size () const { return length; }
+
+            /// Lets the kernel drop the pages of [offset, offset + n), which have been read. They are
+            /// read back from the file if touched again.
+            void done_with (size_t offset, size_t n) const
+            {
+                #ifndef _WIN32
+                    const size_t page = static_cast<size_t> (sysconf (_SC_PAGESIZE));
+                    size_t from = (offset + page - 1) / page * page;
+                    size_t to   = std::min (length, offset + n) / page * page;
+                    if (to > from)
+                        madvise (const_cast<std::byte*> (data) + from, to - from, MADV_DONTNEED);
+                #else
+                    (void) offset; (void) n;
+                #endif
+            }
+
+            private:
+            void close ()
+            {
+                #ifdef _WIN32
+                    if (data != nullptr)
+                        UnmapViewOfFile (data);
+                    if (mapping != nullptr)
+                        CloseHandle (mapping);
+                    if (file != INVALID_HANDLE_VALUE)
+                        CloseHandle (file);
+                    mapping = nullptr;
+                    file = INVALID_HANDLE_VALUE;
+                #else
+                    if (data != nullptr)
+                        munmap (const_cast<std::byte*> (data), length);
+                    if (fd >= 0)
+                        ::close (fd);
+                    fd = -1;
+                #endif
+                data = nullptr;
+            }
+
+            const std::byte* data = nullptr;
+            size_t length = 0;
+            #ifdef _WIN32
+            HANDLE file = INVALID_HANDLE_VALUE;
+            HANDLE mapping = nullptr;
+            #else
+            int fd = -1;
+            #endif
+        };
+
+        /// Bytes compared per step. Small enough to keep the mapped golden file's resident part bounded.
+        inline constexpr size_t GOLDEN_CHUNK = 4 << 20;
+
+        /// Offset of the first byte where actual and golden differ, or the shorter size when one is a
+        /// prefix of the other; equal to both sizes when they match.
+        inline size_t first_golden_mismatch (std::span<const std::byte> actual, const MappedFile& golden)
+        {
+            const unsigned char* a = reinterpret_cast<const unsigned char*> (actual.data ());
+            const unsigned char* g = reinterpret_cast<const unsigned char*> (golden.bytes ().data ());
+            const size_t n = std::min (actual.size (), golden.size ());
+            for (size_t offset = 0; offset < n; offset += GOLDEN_CHUNK)
+            {
+                size_t chunk = std::min (GOLDEN_CHUNK, n - offset);
+                size_t i = first_mismatch (a + offset, g + offset, chunk);
+                if (i < chunk)
+                    return offset + i;
+                golden.done_with (offset, chunk);
+            }
+            return n;
+        }
+
+        /// Whether CHECK_MATCHES_GOLDEN rewrites golden files that are missing or differ. Off by default.
+        inline std::atomic<bool> golden_update_on = false;
+
+        inline void enable_golden_update (bool on) { golden_update_on.store (on, std::memory_order_relaxed); }
+        inline bool golden_update_enabled () { return golden_update_on.load (std::memory_order_relaxed); }
+
+        /// Replaces path with bytes atomically: writes a temporary file in the same directory, flushes
+        /// it to disk and renames it over path.
+        inline void write_file_atomically (const std::filesystem::path& path, std::span<const std::byte> bytes)
+        {
+            if (path.has_parent_path ())
+                std::filesystem::create_directories (path.parent_path ());
+            std::filesystem::path tmp = path;
+            #ifdef _WIN32
+                tmp += ".tmp" + std::to_string (GetCurrentProcessId ());
+            #else
+                tmp += ".tmp" + std::to_string (getpid ());
+            #endif
+            {
+                std::ofstream os (tmp, std::ios::binary | std::ios::trunc);
+                os.write (reinterpret_cast<const char*> (bytes.data ()), static_cast<std::streamsize> (bytes.size ()));
+                os.flush ();
+                if (!os)
+                {
+                    std::error_code ignored;
+                    std::filesystem::remove (tmp, ignored);
+                    throw std::runtime_error ("cannot write " + tmp.string ());
+                }
+            }
+            #ifndef _WIN32
+                int fd = ::open (tmp.c_str (), O_RDONLY | O_CLOEXEC);
+                if (fd >= 0)
+                {
+                    fsync (fd);
+                    ::close (fd);
+                }
+            #endif
+            std::filesystem::rename (tmp, path);
+        }
+    }  // namespace unit_test
+}  // namespace pensar_digital
+
+#endif // GOLDEN_HPP
@@ -0,0 +1,490 @@
+#ifndef HISTORY_HPP
+#define HISTORY_HPP
+
+#include "test.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
+#include <map>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#ifdef _WIN32
+    #ifndef WIN32_LEAN_AND_MEAN
+        #define WIN32_LEAN_AND_MEAN
+    #endif
+    #ifndef NOMINMAX
+        #define NOMINMAX
+    #endif
+    #include <windows.h>
+#else
+    #include <fcntl.h>
+    #include <sys/file.h>
+    #include <unistd.h>
+#endif
+
+namespace pensar_digital
+{
+    namespace unit_test
+    {
+        /// Timing of one test in one run.
+        struct HistoryEntry
+        {
+            Id      id          = NULL_ID;
+            S       name;
+            int64_t nanoseconds = 0;
+            bool    ok          = true;
+            PerfCounters perf;
+        };
+
+        /// The tests timed by one run of a suite (one iteration, with --repeat).
+        struct HistoryRun
+        {
+            int64_t timestamp = 0;   ///< Nanoseconds since the epoch, system clock.
+            std::vector<HistoryEntry> entries;
+        };
+
+        /// Append-only binary file of HistoryRuns. The file starts with MAGIC; each run is a record
+        /// tag and payload size followed by the payload. append () holds an exclusive lock on the file,
+        /// cuts off the truncated last record an interrupted append may have left and then writes the
+        /// record with one write call (O_APPEND on POSIX), so runs appending to the same history at once
+        /// neither interleave nor cut off each other's records.
+        /// Payload: timestamp i64, entry count u32, then per entry id i64, nanoseconds i64, ok u8,
+        /// perf bitmask u32, one u64 per available counter, name length u16 and the name's code units.
+        /// Integers are in host byte order; the file is meant for the machine that runs the tests.
+        class TimingHistory
+        {
+            public:
+            static constexpr char MAGIC[8] = { 'U', 'T', 'H', 'I', 'S', 'T', '1', '\n' };
+            static constexpr uint32_t RUN_TAG = 0x4E555254; // "TRUN"
+
+            static void append (const std::filesystem::path& path, const HistoryRun& run)
+            {
+                std::string payload;
+                put (payload, run.timestamp);
+                put (payload, static_cast<uint32_t> (run.entries.size ()));
+                for (const HistoryEntry& e : run.entries)
+                {
+                    put (payload, static_cast<int64_t> (e.id));
+                    put (payload, e.nanoseconds);
+                    put (payload, static_cast<uint8_t> (e.ok));
+                    put (payload, e.perf.available);
+                    for (uint8_t k = 0; k < PerfCounters::EVENT_COUNT; ++k)
+                        if (e.perf.has (static_cast<PerfCounters::Event> (k)))
+                            put (payload, e.perf.values[k]);
+                    uint16_t length = static_cast<uint16_t> (std::min<size_t> (e.name.size (), UINT16_MAX));
+                    put (payload, length);
+                    payload.append (reinterpret_cast<const char*> (e.name.data ()), length * sizeof (C));
+                }
+                std::string record;
+                #ifdef _WIN32
+                    HANDLE file = CreateFileW (path.c_str (), GENERIC_WRITE, FILE_SHARE_READ | FILE_SHARE_WRITE, nullptr,
+                                               OPEN_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr);
+                    if (file == INVALID_HANDLE_VALUE)
+                        throw std::runtime_error ("cannot open timing history " + path.string ());
+                    OVERLAPPED lock = {};
+                    lock.OffsetHigh = 0x80000000;   // Locks a range past any real data, so readers are not blocked.
+                    LockFileEx (file, LOCKFILE_EXCLUSIVE_LOCK, 0, 1, 0, &lock);
+                #else
+                    int file = ::open (path.c_str (), O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+                    if (file < 0)
+                        throw std::runtime_error ("cannot open timing history " + path.string ());
+                    flock (file, LOCK_EX);
+                #endif
+                auto release = [&]
+                {
+                    #ifdef _WIN32
+                        UnlockFileEx (file, 0, 1, 0, &lock);
+                        CloseHandle (file);
+                    #else
+                        ::close (file);
+                    #endif
+                };
+                bool ok;
+                try
+                {
+                    std::error_code ignored;
+                    uintmax_t size = std::filesystem::file_size (path, ignored);
+                    uintmax_t valid = valid_size (path);
+                    if (valid == 0)
+                        record.append (MAGIC, sizeof (MAGIC));
+                    put (record, RUN_TAG);
+                    put (record, static_cast<uint32_t> (payload.size ()));
+                    record += payload;
+                    #ifdef _WIN32
+                        LARGE_INTEGER end;
+                        end.QuadPart = static_cast<LONGLONG> (valid);
+                        DWORD written = 0;
+                        ok = SetFilePointerEx (file, end, nullptr, FILE_BEGIN)
+                          && (size == valid || SetEndOfFile (file))
+                          && WriteFile (file, record.data (), static_cast<DWORD> (record.size ()), &written, nullptr)
+                          && written == record.size ();
+                    #else
+                        ok = (size == valid || ftruncate (file, static_cast<off_t> (valid)) == 0)
+                          && ::write (file, record.data (), record.size ()) == static_cast<ssize_t> (record.size ());
+                    #endif
+                }
+                catch (...)
+                {
+                    release ();
+                    throw;
+                }
+                release ();
+                if (!ok)
+                    throw std::runtime_error ("cannot append to timing history " + path.string ());
+            }
+
+            /// The last runs in the file, oldest first. Empty when the file is missing or not a history.
+            static std::vector<HistoryRun> load (const std::filesystem::path& path, size_t last = SIZE_MAX)
+            {
+                std::deque<HistoryRun> runs;
+                std::ifstream is (path, std::ios::binary);
+                char magic[sizeof (MAGIC)];
+                if (!is.read (magic, sizeof (magic)) || std::memcmp (magic, MAGIC, sizeof (MAGIC)) != 0)
+                    return {};
+                std::string payload;
+                uint32_t tag;
+                uint32_t size;
+                while (get (is, tag) && get (is, size) && tag == RUN_TAG)
+                {
+                    payload.resize (size);
+                    if (!is.read (payload.data (), size))
+                        break;
+                    HistoryRun run;
+                    if (!parse (payload, run))
+                        break;
+                    runs.push_back (std::move (run));
+                    if (runs.size () > last)
+                        runs.pop_front ();
+                }
+                return std::vector<HistoryRun> (std::make_move_iterator (runs.begin ()), std::make_move_iterator (runs.end ()));
+            }
+
+            /// Bytes of path up to the end of its last complete record: 0 for a missing or empty file,
+            /// less than the file size after an interrupted append, whose tail the next append cuts off.
+            /// Throws rather than touch a file that is not a history.
+            static uintmax_t valid_size (const std::filesystem::path& path)
+            {
+                std::ifstream is (path, std::ios::binary | std::ios::ate);
+                if (!is || is.tellg () <= 0)
+                    return 0;
+                const uintmax_t size = static_cast<uintmax_t> (is.tellg ());
+                char magic[sizeof (MAGIC)];
+                if (!is.seekg (0) || !is.read (magic, sizeof (magic)) || std::memcmp (magic, MAGIC, sizeof (MAGIC)) != 0)
+                    throw std::runtime_error ("not a timing history: " + path.string ());
+                uintmax_t valid = sizeof (MAGIC);
+                uint32_t tag;
+                uint32_t length;
+                while (get (is, tag) && get (is, length) && tag == RUN_TAG && valid + 2 * sizeof (uint32_t) + length <= size)
+                {
+                    valid += 2 * sizeof (uint32_t) + length;
+                    is.seekg (static_cast<std::streamoff> (valid));
+                }
+                return valid;
+            }
+
+            private:
+            template <typename T>
+            static void put (std::string& out, T value) { out.append (reinterpret_cast<const char*> (&value), sizeof (T)); }
+
+            template <typename T>
+            static bool get (std::istream& is, T& value) { return static_cast<bool> (is.read (reinterpret_cast<char*> (&value), sizeof (T))); }
+
+            template <typename T>
+            static bool take (std::string_view& in, T& value)
+            {
+                if (in.size () < sizeof (T))
+                    return false;
+                std::memcpy (&value, in.data (), sizeof (T));
+                in.remove_prefix (sizeof (T));
+                return true;
+            }
+
+            static bool parse (std::string_view in, HistoryRun& run)
+            {
+                uint32_t count;
+                if (!take (in, run.timestamp) || !take (in, count))
+                    return false;
+                run.entries.resize (count);
+                for (HistoryEntry& e : run.entries)
+                {
+                    int64_t id;
+                    uint8_t ok;
+                    uint16_t length;
+                    if (!take (in, id) || !take (in, e.nanoseconds) || !take (in, ok) || !take (in, e.perf.available))
+                        return false;
+                    e.id = static_cast<Id> (id);
+                    e.ok = ok != 0;
+                    for (uint8_t k = 0; k < PerfCounters::EVENT_COUNT; ++k)
+                        if (e.perf.has (static_cast<PerfCounters::Event> (k)) && !take (in, e.perf.values[k]))
+                            return false;
+                    if (!take (in, length) || in.size () < length * sizeof (C))
+                        return false;
+                    e.name.resize (length);
+                    std::memcpy (e.name.data (), in.data (), length * sizeof (C));
+                    in.remove_prefix (length * sizeof (C));
+                }
+                return true;
+            }
+        };
+
+        /// HistoryReporter forwards every event to next and records the tests' timings, appending
+        /// each iteration of a run to the history file as a HistoryRun when it ends. A failed append
+        /// does not interrupt the run: the first error is kept for get_error ().
+        class HistoryReporter : public Reporter
+        {
+            public:
+            /// Throws when afile exists and is not a history, before any test runs.
+            HistoryReporter (Reporter& anext, const std::filesystem::path& afile) : next (anext), file (afile) { TimingHistory::valid_size (file); }
+
+            void report (const TestEvent& e)
+            {
+                switch (e.kind)
+                {
+                    case TestEvent::RUN_START:
+                    case TestEvent::ITERATION:
+                        save ();
+                        current.timestamp = std::chrono::duration_cast<std::chrono::nanoseconds> (std::chrono::system_clock::now ().time_since_epoch ()).count ();
+                        break;
+                    case TestEvent::TEST_PASS:
+                    case TestEvent::TEST_FAIL:
+                        current.entries.push_back (HistoryEntry { e.id, e.name, e.nanoseconds, e.kind == TestEvent::TEST_PASS, e.perf });
+                        break;
+                    case TestEvent::RUN_END:
+                        save ();
+                        break;
+                    default:
+                        break;
+                }
+                next.report (e);
+            }
+
+            void flush () { next.flush (); }
+
+            /// The runs recorded so far.
+            const std::vector<HistoryRun>& get_runs () const { return runs; }
+
+            /// Why appending to the file failed, or empty.
+            const std::string& get_error () const { return error; }
+
+            private:
+            void save ()
+            {
+                if (!current.entries.empty ())
+                {
+                    try
+                    {
+                        if (error.empty ())
+                            TimingHistory::append (file, current);
+                    }
+                    catch (const std::exception& e)
+                    {
+                        error = e.what ();
+                    }
+                    runs.push_back (std::move (current));
+                }
+                current = HistoryRun ();
+            }
+
+            Reporter& next;
+            std::filesystem::path file;
+            HistoryRun current;
+            std::vector<HistoryRun> runs;
+            std::string error;
+        };
+
+        /// One-sided Mann-Whitney U test: the probability, under the null hypothesis that both
+        /// samples come from the same distribution, of a U at least as large as the one observed for
+        /// a tending to exceed b. Normal approximation with tie and continuity corrections.
+        inline double mann_whitney_greater (const std::vector<double>& a, const std::vector<double>& b)
+        {
+            const size_t n1 = a.size ();
+            const size_t n2 = b.size ();
+            if (n1 == 0 || n2 == 0)
+                return 1;
+            std::vector<std::pair<double, bool>> all;
+            all.reserve (n1 + n2);
+            for (double x : a)
+                all.emplace_back (x, true);
+            for (double x : b)
+                all.emplace_back (x, false);
+            std::sort (all.begin (), all.end (), [](const auto& x, const auto& y) { return x.first < y.first; });
+            const double n = static_cast<double> (n1 + n2);
+            double rank_sum = 0;
+            double ties = 0;
+            for (size_t i = 0; i < all.size (); )
+            {
+                size_t j = i;
+                while (j < all.size () && all[j].first == all[i].first)
+                    ++j;
+                const double t = static_cast<double> (j - i);
+                const double rank = (i + 1 + j) / 2.0;
+                for (size_t k = i; k < j; ++k)
+                    if (all[k].second)
+                        rank_sum += rank;
+                ties += t * t * t - t;
+                i = j;
+            }
+            const double u = rank_sum - n1 * (n1 + 1) / 2.0;
+            const double mean = n1 * n2 / 2.0;
+            const double variance = n1 * n2 / 12.0 * ((n + 1) - ties / (n * (n - 1)));
+            if (variance <= 0)
+                return 1;
+            const double z = (u - mean - 0.5) / std::sqrt (variance);
+            return 0.5 * std::erfc (z / std::sqrt (2.0));
+        }
+
+        /// A test that became significantly slower.
+        struct Regression
+        {
+            S      name;
+            double baseline_median = 0;
+            double current_median  = 0;
+            double p               = 1;
+            size_t baseline_samples = 0;
+            size_t current_samples  = 0;
+        };
+
+        /// Thresholds of the regression gate.
+        struct RegressionOptions
+        {
+            size_t baseline_runs = 20;    ///< Most recent runs forming the baseline.
+            double alpha         = 0.01;  ///< Significance level of the Mann-Whitney test.
+            double max_slowdown  = 0.10;  ///< Median slowdown tolerated even when significant (0.10 = 10 %).
+            size_t min_samples   = 3;     ///< Fewer baseline or current samples leave a test unjudged.
+        };
+
+        /// Compares, test by test (by name), the passing timings of current with those of baseline.
+        /// \param compared Set to the number of tests that had enough samples on both sides.
+        inline std::vector<Regression> find_regressions (const std::vector<HistoryRun>& baseline, const std::vector<HistoryRun>& current,
+                                                         const RegressionOptions& options, size_t& compared)
+        {
+            std::map<S, std::pair<std::vector<double>, std::vector<double>>> samples;
+            for (const HistoryRun& run : baseline)
+                for (const HistoryEntry& e : run.entries)
+                    if (e.ok)
+                        samples[e.name].first.push_back (static_cast<double> (e.nanoseconds));
+            for (const HistoryRun& run : current)
+                for (const HistoryEntry& e : run.entries)
+                    if (e.ok)
+                        samples[e.name].second.push_back (static_cast<double> (e.nanoseconds));
+
+            auto median = [](std::vector<double> v)
+            {
+                std::sort (v.begin (), v.end ());
+                size_t n = v.size ();
+                return n % 2 ? v[n / 2] : (v[n / 2 - 1] + v[n / 2]) / 2;
+            };
+            std::vector<Regression> regressions;
+            compared = 0;
+            for (const auto& [name, s] : samples)
+            {
+                const auto& [before, now] = s;
+                if (before.size () < options.min_samples || now.size () < options.min_samples)
+                    continue;
+                ++compared;
+                Regression r { name, median (before), median (now), 1, before.size (), now.size () };
+                if (r.current_median <= r.baseline_median * (1 + options.max_slowdown))
+                    continue;
+                r.p = mann_whitney_greater (now, before);
+                if (r.p < options.alpha)
+                    regressions.push_back (std::move (r));
+            }
+            return regressions;
+        }
+
+        inline void report_regressions (std::basic_ostream<C>& os, const std::vector<Regression>& regressions, size_t compared, size_t baseline_runs)
+        {
+            const std::ios_base::fmtflags flags = os.flags ();
+            const std::streamsize precision = os.precision ();
+            for (const Regression& r : regressions)
+                os << W("performance regression: ") << r.name << W("\tmedian ") << std::fixed << std::setprecision (0) << r.current_median
+                   << W(" ns vs ") << r.baseline_median << W(" ns baseline (+") << std::setprecision (1)
+                   << 100 * (r.current_median / r.baseline_median - 1) << W(" %)\tMann-Whitney p = ") << std::setprecision (4) << r.p
+                   << W(" (") << r.current_samples << W(" vs ") << r.baseline_samples << W(" samples)") << std::endl;
+            os.flags (flags);
+            os.precision (precision);
+            os << W("timing history: ") << compared << W(" tests compared with ") << baseline_runs << W(" baseline runs, ")
+               << regressions.size () << W(" regression(s)") << std::endl;
+        }
+
+        /// Command line side of the timing history, for run_tests ():
+        ///   --history FILE        appends the timings of every run to FILE;
+        ///   --compare-history     also fails the run when a test got significantly slower than in the
+        ///                         last --baseline-runs N runs of FILE (default 20): Mann-Whitney
+        ///                         p < --alpha A (default 0.01) and median slowdown over
+        ///                         --max-slowdown P percent (default 10).
+        /// The current run gives one sample per test per iteration, so the comparison needs --repeat
+        /// (at least RegressionOptions::min_samples).
+        class RegressionGate
+        {
+            public:
+            /// Throws when the history file cannot be read or is not a history.
+            RegressionGate (CompositeTest& asuite, int argc, const char* const argv[]) : suite (asuite)
+            {
+                std::filesystem::path file;
+                for (int i = 1; i < argc; ++i)
+                {
+                    std::string_view arg (argv[i]);
+                    bool has_value = i + 1 < argc;
+                    if (arg == "--history" && has_value)
+                        file = argv[++i];
+                    else if (arg == "--compare-history")
+                        compare = true;
+                    else if (arg == "--baseline-runs" && has_value)
+                        options.baseline_runs = std::strtoull (argv[++i], nullptr, 10);
+                    else if (arg == "--alpha" && has_value)
+                        options.alpha = std::strtod (argv[++i], nullptr);
+                    else if (arg == "--max-slowdown" && has_value)
+                        options.max_slowdown = std::strtod (argv[++i], nullptr) / 100;
+                }
+                if (file.empty ())
+                    return;
+                if (compare)
+                    baseline = TimingHistory::load (file, options.baseline_runs);
+                reporter = &suite.get_reporter ();
+                history = std::make_unique<HistoryReporter> (*reporter, file);
+                suite.set_reporter (history.get ());
+            }
+
+            /// Restores the suite's reporter and, when comparing, reports the regressions. False if any,
+            /// or if the timings could not be appended to the history.
+            bool finish ()
+            {
+                if (!history)
+                    return true;
+                suite.set_reporter (reporter);
+                const bool saved = history->get_error ().empty ();
+                if (!saved)
+                    out () << W("timing history: ") << history->get_error ().c_str () << std::endl;
+                if (!compare)
+                    return saved;
+                size_t compared = 0;
+                std::vector<Regression> regressions = find_regressions (baseline, history->get_runs (), options, compared);
+                report_regressions (out (), regressions, compared, baseline.size ());
+                return regressions.empty () && saved;
+            }
+
+            private:
+            CompositeTest& suite;
+            RegressionOptions options;
+            bool compare = false;
+            std::vector<HistoryRun> baseline;
+            Reporter* reporter = nullptr;
+            std::unique_ptr<HistoryReporter> history;
+        };
+    }  // namespace unit_test
+}  // namespace pensar_digital
+
+#endif // HISTORY_HPP
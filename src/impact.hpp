@@ -0,0 +1,384 @@
+#ifndef IMPACT_HPP
+#define IMPACT_HPP
+
+#include "test.hpp"
+
+#include <algorithm>
+#include <cctype>
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+namespace pensar_digital
+{
+    namespace unit_test
+    {
+        /// ImpactSelector restricts a run to the tests affected by a set of changed files.
+        /// It reads the build's dependency manifests, either Makefile-style .d files (gcc -MD) or
+        /// Code::Blocks .depend files, into a reverse include graph. A changed file affects itself and
+        /// every file that includes it, directly or not. A test is affected when the file its TEST macro
+        /// sits in (Test::get_source_file ()) is.
+        ///
+        /// Parsed manifests can be cached in an index file, which is reused as long as the manifest's
+        /// size and modification time have not changed.
+        class ImpactSelector
+        {
+            public:
+            typedef std::unordered_set<std::string> Files;
+
+            /// Adds the dependencies listed in manifest.
+            ImpactSelector& load (const std::filesystem::path& manifest)
+            {
+                std::ifstream in (manifest, std::ios::binary);
+                if (!in)
+                    throw std::runtime_error ("Cannot read dependency manifest " + manifest.string ());
+                std::string first;
+                std::getline (in, first);
+                in.seekg (0);
+                if (first.rfind ("# depslib", 0) == 0)
+                    parse_depslib (in);
+                else
+                    parse_make (in);
+                return *this;
+            }
+
+            /// Adds the dependencies listed in manifest, using index as a cache of the parsed result.
+            ImpactSelector& load (const std::filesystem::path& manifest, const std::filesystem::path& index)
+            {
+                std::string stamp = stamp_of (manifest);
+                if (load_index (index, stamp))
+                    return *this;
+                ImpactSelector parsed;
+                parsed.load (manifest);
+                parsed.save_index (index, stamp);
+                merge (parsed);
+                return *this;
+            }
+
+            /// changed plus every file that includes one of them, transitively. Paths are normalized.
+            Files affected (const std::vector<std::string>& changed) const
+            {
+                std::unordered_map<std::string, std::vector<std::string>> by_name;
+                for (const auto& [dependency, files] : includers)
+                    by_name[file_name (dependency)].push_back (dependency);
+
+                Files result;
+                std::vector<std::string> pending;
+                for (const std::string& f : changed)
+                {
+                    std::string file = normalize (f);
+                    if (result.insert (file).second)
+                        pending.push_back (file);
+                    // The same file spelled relative to another directory.
+                    auto i = by_name.find (file_name (file));
+                    if (i != by_name.end ())
+                        for (const std::string& known : i->second)
+                            if (same_file (known, file) && result.insert (known).second)
+                                pending.push_back (known);
+                }
+                while (!pending.empty ())
+                {
+                    std::string f = std::move (pending.back ());
+                    pending.pop_back ();
+                    auto i = includers.find (f);
+                    if (i == includers.end ())
+                        continue;
+                    for (const std::string& g : i->second)
+                        if (result.insert (g).second)
+                            pending.push_back (g);
+                }
+                return result;
+            }
+
+            /// Makes suite run only the tests affected by changed. Returns how many tests were selected.
+            size_t select (CompositeTest& suite, const std::vector<std::string>& changed) const
+            {
+                Files files = affected (changed);
+                std::unordered_map<std::string, std::vector<std::string>> by_name;
+                for (const std::string& f : files)
+                    by_name[file_name (f)].push_back (f);
+
+                std::unordered_set<const Test*> selected;
+                for (const CompositeTest::TestDescriptor& d : suite.get_registry ())
+                    if (contains (by_name, normalize (d.test->get_source_file ())))
+                        selected.insert (d.test);
+                size_t count = selected.size ();
+                suite.set_filter ([selected = std::move (selected)](const Test& t) { return selected.count (&t) != 0; });
+                return count;
+            }
+
+            /// Forward slashes, lexically normal; lower case for Windows paths.
+            static std::string normalize (std::string_view file)
+            {
+                std::string s (file);
+                std::replace (s.begin (), s.end (), '\\', '/');
+                #ifndef _WIN32
+                if (!(s.size () > 1 && s[1] == ':'))
+                    return std::filesystem::path (s).lexically_normal ().generic_string ();
+                #endif
+                std::transform (s.begin (), s.end (), s.begin (), [](unsigned char c) { return static_cast<char> (std::tolower (c)); });
+                return std::filesystem::path (s).lexically_normal ().generic_string ();
+            }
+
+            private:
+            static std::string file_name (const std::string& normalized)
+            {
+                size_t slash = normalized.rfind ('/');
+                return slash == std::string::npos ? normalized : normalized.substr (slash + 1);
+            }
+
+            /// True when file names one of files. Paths spelled relative to different directories
+            /// match when the shorter, without its leading "../" parts, is a suffix of the longer.
+            static bool contains (const std::unordered_map<std::string, std::vector<std::string>>& by_name, const std::string& file)
+            {
+                auto i = by_name.find (file_name (file));
+                if (i == by_name.end ())
+                    return false;
+                for (const std::string& candidate : i->second)
+                    if (same_file (candidate, file))
+                        return true;
+                return false;
+            }
+
+            static bool same_file (std::string_view a, std::string_view b)
+            {
+                a = strip_parents (a);
+                b = strip_parents (b);
+                std::string_view shorter = a.size () < b.size () ? a : b;
+                std::string_view longer  = a.size () < b.size () ? b : a;
+                return longer.substr (longer.size () - shorter.size ()) == shorter &&
+                       (longer.size () == shorter.size () || longer[longer.size () - shorter.size () - 1] == '/');
+            }
+
+            static std::string_view strip_parents (std::string_view path)
+            {
+                while (path.rfind ("../", 0) == 0 || path.rfind ("./", 0) == 0)
+                    path.remove_prefix (path[1] == '/' ? 2 : 3);
+                return path;
+            }
+
+            void depends (const std::string& file, const std::string& dependency)
+            {
+                std::string f = normalize (file);
+                std::string d = normalize (dependency);
+                if (f != d)
+                    includers[d].push_back (f);
+            }
+
+            /// target: source header1 header2, continued over lines ending in a backslash.
+            void parse_make (std::istream& in)
+            {
+                std::string rule;
+                std::string line;
+                while (std::getline (in, line))
+                {
+                    if (!line.empty () && line.back () == '\r')
+                        line.pop_back ();
+                    if (!line.empty () && line.back () == '\\')
+                    {
+                        line.pop_back ();
+                        rule += line + ' ';
+                        continue;
+                    }
+                    rule += line;
+                    parse_rule (rule);
+                    rule.clear ();
+                }
+                parse_rule (rule);
+            }
+
+            void parse_rule (const std::string& rule)
+            {
+                // The target ends at the first ':' followed by white space; "c:\..." is not a separator.
+                size_t colon = 0;
+                for (; (colon = rule.find (':', colon)) != std::string::npos; ++colon)
+                    if (colon + 1 == rule.size () || std::isspace (static_cast<unsigned char> (rule[colon + 1])))
+                        break;
+                if (colon == std::string::npos)
+                    return;
+                std::vector<std::string> prerequisites;
+                std::string word;
+                for (size_t i = colon + 1; i <= rule.size (); ++i)
+                {
+                    if (i < rule.size () && rule[i] == '\\' && i + 1 < rule.size () && rule[i + 1] == ' ')
+                        word += rule[++i];
+                    else if (i == rule.size () || std::isspace (static_cast<unsigned char> (rule[i])))
+                    {
+                        if (!word.empty ())
+                            prerequisites.push_back (std::move (word));
+                        word.clear ();
+                    }
+                    else
+                        word += rule[i];
+                }
+                // The first prerequisite is the translation unit; the rest are the headers it includes.
+                for (size_t i = 1; i < prerequisites.size (); ++i)
+                    depends (prerequisites[0], prerequisites[i]);
+            }
+
+            /// 1680120053 source:c:\mg\prj\unit-test\test.cpp
+            /// 	"test.hpp"
+            /// 	<iostream>
+            void parse_depslib (std::istream& in)
+            {
+                std::string line;
+                std::filesystem::path file;
+                while (std::getline (in, line))
+                {
+                    if (!line.empty () && line.back () == '\r')
+                        line.pop_back ();
+                    if (line.empty () || line[0] == '#')
+                        continue;
+                    if (line[0] == '\t' || line[0] == ' ')
+                    {
+                        size_t open = line.find ('"');
+                        size_t close = open == std::string::npos ? open : line.find ('"', open + 1);
+                        if (close == std::string::npos || file.empty ())
+                            continue;   // <system> headers never change with the project.
+                        std::string include = line.substr (open + 1, close - open - 1);
+                        std::replace (include.begin (), include.end (), '\\', '/');
+                        depends (file.generic_string (), (file.parent_path () / include).generic_string ());
+                        continue;
+                    }
+                    size_t space = line.find (' ');
+                    std::string name = space == std::string::npos ? line : line.substr (space + 1);
+                    if (name.rfind ("source:", 0) == 0)
+                        name.erase (0, 7);
+                    std::replace (name.begin (), name.end (), '\\', '/');
+                    file = name;
+                }
+            }
+
+            void merge (const ImpactSelector& other)
+            {
+                for (const auto& [dependency, files] : other.includers)
+                {
+                    std::vector<std::string>& mine = includers[dependency];
+                    mine.insert (mine.end (), files.begin (), files.end ());
+                }
+            }
+
+            static std::string stamp_of (const std::filesystem::path& manifest)
+            {
+                std::ostringstream ss;
+                ss << std::filesystem::file_size (manifest) << ' '
+                   << std::filesystem::last_write_time (manifest).time_since_epoch ().count ();
+                return ss.str ();
+            }
+
+            /// Index format: a header line with the manifest's stamp, then one line per dependency:
+            /// the dependency followed by the files including it, tab separated.
+            bool load_index (const std::filesystem::path& index, const std::string& stamp)
+            {
+                std::ifstream in (index, std::ios::binary);
+                std::string line;
+                if (!in || !std::getline (in, line) || line != INDEX_HEADER + stamp)
+                    return false;
+                ImpactSelector loaded;
+                while (std::getline (in, line))
+                {
+                    std::vector<std::string> fields;
+                    for (size_t from = 0, to; from <= line.size (); from = to + 1)
+                    {
+                        to = line.find ('\t', from);
+                        if (to == std::string::npos)
+                            to = line.size ();
+                        fields.push_back (line.substr (from, to - from));
+                    }
+                    std::vector<std::string>& files = loaded.includers[fields[0]];
+                    files.insert (files.end (), fields.begin () + 1, fields.end ());
+                }
+                merge (loaded);
+                return true;
+            }
+
+            void save_index (const std::filesystem::path& index, const std::string& stamp) const
+            {
+                std::filesystem::path tmp = index;
+                tmp += ".tmp";
+                {
+                    std::ofstream out (tmp, std::ios::binary | std::ios::trunc);
+                    out << INDEX_HEADER << stamp << '\n';
+                    for (const auto& [dependency, files] : includers)
+                    {
+                        out << dependency;
+                        for (const std::string& f : files)
+                            out << '\t' << f;
+                        out << '\n';
+                    }
+                }
+                std::error_code ec;
+                std::filesystem::rename (tmp, index, ec);
+            }
+
+            inline static const std::string INDEX_HEADER = "unit_test impact index 1 ";
+
+            /// Dependency -> files that include it directly.
+            std::unordered_map<std::string, std::vector<std::string>> includers;
+        };
+
+        /// Applies the impact selection options to suite and ignores the others:
+        /// --depend FILE (repeatable), --impact-index FILE, --changed A,B,... or --changed @LIST_FILE.
+        /// Without --changed the suite is left unfiltered.
+        inline void select_impacted (CompositeTest& suite, int argc, const char* const argv[])
+        {
+            std::vector<std::filesystem::path> manifests;
+            std::filesystem::path index;
+            std::vector<std::string> changed;
+            bool selecting = false;
+            for (int i = 1; i + 1 < argc; ++i)
+            {
+                std::string_view arg (argv[i]);
+                if (arg == "--depend")
+                    manifests.push_back (argv[++i]);
+                else if (arg == "--impact-index")
+                    index = argv[++i];
+                else if (arg == "--changed")
+                {
+                    selecting = true;
+                    std::string value (argv[++i]);
+                    if (!value.empty () && value[0] == '@')
+                    {
+                        std::ifstream in (value.substr (1));
+                        for (std::string line; std::getline (in, line); )
+                            if (!line.empty ())
+                                changed.push_back (line);
+                    }
+                    else
+                        for (size_t from = 0, to; from < value.size (); from = to + 1)
+                        {
+                            to = value.find (',', from);
+                            if (to == std::string::npos)
+                                to = value.size ();
+                            if (to > from)
+                                changed.push_back (value.substr (from, to - from));
+                        }
+                }
+            }
+            if (!selecting)
+                return;
+            ImpactSelector selector;
+            for (size_t m = 0; m < manifests.size (); ++m)
+            {
+                if (index.empty ())
+                    selector.load (manifests[m]);
+                else
+                {
+                    std::filesystem::path manifest_index = index;
+                    if (m > 0)
+                        manifest_index += "." + std::to_string (m);
+                    selector.load (manifests[m], manifest_index);
+                }
+            }
+            selector.select (suite, changed);
+        }
+    }  // namespace unit_test
+}  // namespace pensar_digital
+
+#endif // IMPACT_HPP
@@ -0,0 +1,245 @@
+#ifndef LATENCY_HPP
+#define LATENCY_HPP
+
+#include "benchmark.hpp"
+
+#include <algorithm>
+#include <bit>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <iomanip>
+#include <memory>
+#include <thread>
+
+namespace pensar_digital
+{
+    namespace unit_test
+    {
+        /// HDR histogram of nanosecond values: every value from 1 ns to highest is recorded with
+        /// significant_digits decimal digits of precision. The buckets are allocated once, by the
+        /// constructor, so record () never allocates and takes constant time. Values above highest
+        /// are counted as highest; max () still returns the largest value recorded.
+        class LatencyHistogram
+        {
+            public:
+            static constexpr uint64_t DEFAULT_HIGHEST = 3600ull * 1000 * 1000 * 1000; // One hour.
+
+            explicit LatencyHistogram (uint64_t ahighest = DEFAULT_HIGHEST, unsigned significant_digits = 3) :
+                highest (std::max<uint64_t> (ahighest, 2))
+            {
+                significant_digits = std::clamp (significant_digits, 1u, 5u);
+                uint64_t largest_single_unit = 2;
+                for (unsigned i = 0; i < significant_digits; ++i)
+                    largest_single_unit *= 10;
+                sub_bucket_count_magnitude = static_cast<unsigned> (std::bit_width (largest_single_unit - 1));
+                sub_bucket_half_count_magnitude = sub_bucket_count_magnitude - 1;
+                sub_bucket_count = uint64_t (1) << sub_bucket_count_magnitude;
+                sub_bucket_half_count = sub_bucket_count / 2;
+                sub_bucket_mask = sub_bucket_count - 1;
+                unsigned bucket_count = 1;
+                for (uint64_t smallest_untrackable = sub_bucket_count; smallest_untrackable <= highest && bucket_count < 64; smallest_untrackable <<= 1)
+                    ++bucket_count;
+                length = (bucket_count + 1) * sub_bucket_half_count;
+                counts = std::make_unique<uint64_t[]> (length);
+            }
+
+            void record (uint64_t value, uint64_t count = 1)
+            {
+                if (value > max_value)
+                    max_value = value;
+                if (value < min_value)
+                    min_value = value;
+                total += count;
+                sum   += static_cast<double> (value) * count;
+                counts[index_of (std::min (value, highest))] += count;
+            }
+
+            /// Records value and, for a loop meant to start an operation every expected_interval ns, the
+            /// samples a stall of value ns kept it from taking: value - interval, value - 2 interval, ...
+            /// This corrects coordinated omission when the operations were timed from their actual start.
+            void record_corrected (uint64_t value, uint64_t expected_interval)
+            {
+                record (value);
+                if (expected_interval == 0)
+                    return;
+                for (uint64_t missing = value > expected_interval ? value - expected_interval : 0; missing >= expected_interval; missing -= expected_interval)
+                    record (missing);
+            }
+
+            void reset ()
+            {
+                std::fill (counts.get (), counts.get () + length, 0);
+                total = 0;
+                sum = 0;
+                max_value = 0;
+                min_value = UINT64_MAX;
+            }
+
+            uint64_t count () const { return total; }
+            uint64_t max   () const { return max_value; }
+            uint64_t min   () const { return total == 0 ? 0 : min_value; }
+            double   mean  () const { return total == 0 ? 0 : sum / total; }
+
+            /// Smallest recorded value v such that percentile % of the values are <= v, to within the
+            /// histogram's precision (reported as the highest value equivalent to v).
+            uint64_t percentile (double percentile) const
+            {
+                if (total == 0)
+                    return 0;
+                // Less a few ulps, so a percentile that is a whole rank in decimal, like 99.9 of 1000, is
+                // not rounded up to the next rank by the binary error in percentile.
+                const double exact = std::clamp (percentile, 0.0, 100.0) * total / 100;
+                uint64_t rank = static_cast<uint64_t> (std::ceil (exact * (1 - 1e-14)));
+                rank = std::max<uint64_t> (rank, 1);
+                uint64_t seen = 0;
+                for (size_t i = 0; i < length; ++i)
+                {
+                    seen += counts[i];
+                    if (seen >= rank)
+                        return std::min (highest_equivalent (value_at (i)), max_value);
+                }
+                return max_value;
+            }
+
+            private:
+            size_t index_of (uint64_t value) const
+            {
+                unsigned bucket = static_cast<unsigned> (64 - std::countl_zero (value | sub_bucket_mask)) - sub_bucket_count_magnitude;
+                uint64_t sub_bucket = value >> bucket;
+                return static_cast<size_t> (((uint64_t (bucket) + 1) << sub_bucket_half_count_magnitude) + (sub_bucket - sub_bucket_half_count));
+            }
+
+            uint64_t value_at (size_t index) const
+            {
+                int64_t  bucket     = static_cast<int64_t> (index >> sub_bucket_half_count_magnitude) - 1;
+                uint64_t sub_bucket = (index & (sub_bucket_half_count - 1)) + sub_bucket_half_count;
+                if (bucket < 0)
+                {
+                    sub_bucket -= sub_bucket_half_count;
+                    bucket = 0;
+                }
+                return sub_bucket << bucket;
+            }
+
+            uint64_t highest_equivalent (uint64_t value) const
+            {
+                unsigned bucket = static_cast<unsigned> (64 - std::countl_zero (value | sub_bucket_mask)) - sub_bucket_count_magnitude;
+                uint64_t sub_bucket = value >> bucket;
+                if (sub_bucket >= sub_bucket_count)
+                    ++bucket;
+                uint64_t range = uint64_t (1) << bucket;
+                return (value & ~(range - 1)) + range - 1;
+            }
+
+            uint64_t highest;
+            unsigned sub_bucket_count_magnitude;
+            unsigned sub_bucket_half_count_magnitude;
+            uint64_t sub_bucket_count;
+            uint64_t sub_bucket_half_count;
+            uint64_t sub_bucket_mask;
+            size_t   length;
+            std::unique_ptr<uint64_t[]> counts;
+            uint64_t total = 0;
+            double   sum   = 0;
+            uint64_t max_value = 0;
+            uint64_t min_value = UINT64_MAX;
+        };
+
+        /// Percentile table: count, mean, min, p50 ... p99.99 and max, in nanoseconds.
+        template <typename Char>
+        std::basic_ostream<Char>& operator<< (std::basic_ostream<Char>& os, const LatencyHistogram& h)
+        {
+            static const char* names[]       = { "p50", "p90", "p99", "p99.9", "p99.99" };
+            static const double percentiles[] = {  50,    90,    99,    99.9,    99.99  };
+            os << "count " << h.count () << "\tmean " << static_cast<uint64_t> (h.mean () + 0.5) << "\tmin " << h.min ();
+            for (size_t i = 0; i < 5; ++i)
+                os << '\t' << names[i] << ' ' << h.percentile (percentiles[i]);
+            return os << "\tmax " << h.max () << " ns";
+        }
+
+        /// State of a CHECK_LATENCY block: runs its body iterations times and times each run.
+        /// With an interval, runs are paced to start every interval and each latency is taken from the
+        /// run's scheduled start, so a slow run also charges the delay it causes to the runs behind
+        /// it, as a throttled client would see. Without one, runs go back to back.
+        class LatencyRecorder
+        {
+            public:
+            inline static BenchmarkClock DEFAULT_CLOCK = BenchmarkClock::STEADY;
+
+            LatencyRecorder (uint64_t aiterations, std::chrono::nanoseconds ainterval = std::chrono::nanoseconds::zero (), BenchmarkClock clock = DEFAULT_CLOCK) :
+                timer (clock), iterations (aiterations), interval (static_cast<double> (ainterval.count ())) {}
+
+            /// True on the first call only, so the block is entered once.
+            bool once () { bool first = !done; done = true; return first; }
+
+            /// Records the run that just ended, if any, and starts the next one. False after the last.
+            bool next ()
+            {
+                clobber_memory ();
+                double now = timer.now ();
+                if (started > 0)
+                    histogram.record (static_cast<uint64_t> (std::max (0.0, now - scheduled)));
+                if (started == iterations)
+                    return false;
+                scheduled = started == 0 || interval <= 0 ? now : scheduled + interval;
+                for (; now < scheduled; now = timer.now ())
+                    if (scheduled - now > 2e6)
+                        std::this_thread::sleep_for (std::chrono::nanoseconds (static_cast<int64_t> (scheduled - now - 1e6)));
+                ++started;
+                clobber_memory ();
+                return true;
+            }
+
+            const LatencyHistogram& get_histogram () const { return histogram; }
+
+            private:
+            BenchmarkTimer timer;
+            uint64_t iterations;
+            double interval;
+            uint64_t started = 0;
+            double scheduled = 0;
+            bool done = false;
+            LatencyHistogram histogram;
+        };
+
+        /// Fails t through Test::error when a percentile of h exceeds its limit; a zero limit is not
+        /// checked. On failure the whole percentile table precedes the error line.
+        inline bool check_latency (const Test& t, const LatencyHistogram& h, std::chrono::nanoseconds p50, std::chrono::nanoseconds p99,
+                                   std::chrono::nanoseconds p999, Text error_message, const Location& where = std::source_location::current ())
+        {
+            const std::pair<double, std::chrono::nanoseconds> limits[] = { { 50, p50 }, { 99, p99 }, { 99.9, p999 } };
+            for (const auto& [p, limit] : limits)
+            {
+                uint64_t actual = h.percentile (p);
+                if (limit.count () <= 0 || actual <= static_cast<uint64_t> (limit.count ())) [[likely]]
+                    continue;
+                test_out () << t.get_name () << W("\t") << h << std::endl;
+                SStream a;
+                SStream e;
+                a << W("p") << p << W(" ") << actual << W(" ns");
+                e << W("<= ") << limit.count () << W(" ns");
+                t.error<S> (a.str (), e.str (), error_message, where);
+                return false;
+            }
+            return true;
+        }
+
+        /// CHECK_LATENCY(iterations, p50, p99, p999) { body } runs body iterations times, records the
+        /// time of each run in a LatencyHistogram and fails when the 50th, 99th or 99.9th percentile
+        /// exceeds its limit (std::chrono durations; 0 for none). break ends the runs early.
+        #define CHECK_LATENCY(iterations, p50, p99, p999)                                                  \
+                                  for (LatencyRecorder latency_ (iterations); latency_.once ();                  \
+                                       check_latency (*this, latency_.get_histogram (), p50, p99, p999, W("CHECK_LATENCY"))) \
+                                      while (latency_.next ())
+
+        /// CHECK_LATENCY_EVERY(interval, iterations, p50, p99, p999) { body } is CHECK_LATENCY for a loop
+        /// throttled to one run per interval, with latencies corrected for coordinated omission.
+        #define CHECK_LATENCY_EVERY(interval, iterations, p50, p99, p999)                                  \
+                                  for (LatencyRecorder latency_ (iterations, interval); latency_.once ();        \
+                                       check_latency (*this, latency_.get_histogram (), p50, p99, p999, W("CHECK_LATENCY_EVERY"))) \
+                                      while (latency_.next ())
+    }  // namespace unit_test
+}  // namespace pensar_digital
+
+#endif // LATENCY_HPP
@@ -1,12 +1,11 @@
 // author : Mauricio Gomes
 // license: MIT (https://opensource.org/licenses/MIT)
 
-#include <iostream>
+// Runs the library's own tests, from the test directory.
 
-using namespace std;
+#include "test_fwd.hpp"
 
-int main()
+int main (int argc, const char* argv[])
 {
-    cout << "Hello world!" << endl;
-    return 0;
+    return pensar_digital::unit_test::run_tests (argc, argv);
 }
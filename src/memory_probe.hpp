@@ -0,0 +1,89 @@
+#ifndef MEMORY_PROBE_HPP
+#define MEMORY_PROBE_HPP
+
+#include "memory_usage.hpp"
+
+#include <algorithm>
+#include <cstdint>
+
+#if defined(__linux__)
+    #include <fcntl.h>
+    #include <unistd.h>
+#elif defined(_WIN32)
+    #include <windows.h>
+    #include <psapi.h>
+#endif
+
+namespace pensar_digital
+{
+    namespace unit_test
+    {
+        /// Resident set size of the process in bytes, or 0 where it cannot be read. Never allocates.
+        inline int64_t resident_set_bytes ()
+        {
+            #if defined(__linux__)
+                int fd = ::open ("/proc/self/statm", O_RDONLY | O_CLOEXEC);
+                if (fd < 0)
+                    return 0;
+                char text[128];
+                ssize_t n = ::read (fd, text, sizeof (text) - 1);
+                ::close (fd);
+                if (n <= 0)
+                    return 0;
+                text[n] = 0;
+                // "size resident shared text lib data dt", in pages.
+                const char* p = text;
+                while (*p != 0 && *p != ' ')
+                    ++p;
+                int64_t pages = 0;
+                for (++p; *p >= '0' && *p <= '9'; ++p)
+                    pages = pages * 10 + (*p - '0');
+                static const int64_t page_size = ::sysconf (_SC_PAGESIZE);
+                return pages * page_size;
+            #elif defined(_WIN32)
+                PROCESS_MEMORY_COUNTERS counters;
+                if (!GetProcessMemoryInfo (GetCurrentProcess (), &counters, sizeof (counters)))
+                    return 0;
+                return static_cast<int64_t> (counters.WorkingSetSize);
+            #else
+                return 0;
+            #endif
+        }
+
+        /// Measures the memory activity of the current thread from construction to stop ().
+        /// Probes nest: stop () restores the enclosing probe's peak. The resident set size is process
+        /// wide, so its delta is only meaningful when tests run one at a time. It is read only when the
+        /// allocation hooks are installed, so an untracked run costs no system calls per test.
+        class MemoryProbe
+        {
+            public:
+            MemoryProbe () :
+                tracked (allocation_hooks_installed.load (std::memory_order_relaxed)),
+                rss (tracked ? resident_set_bytes () : 0),
+                start (allocation_counters)
+            {
+                allocation_counters.peak = allocation_counters.live;
+            }
+
+            MemoryUsage stop ()
+            {
+                const AllocationCounters now = allocation_counters;
+                MemoryUsage u;
+                u.tracked     = tracked;
+                u.allocations = now.allocations - start.allocations;
+                u.bytes       = now.bytes - start.bytes;
+                u.peak_bytes  = now.peak - start.live;
+                u.rss_delta   = tracked ? resident_set_bytes () - rss : 0;
+                allocation_counters.peak = std::max (start.peak, now.peak);
+                return u;
+            }
+
+            private:
+            bool tracked;
+            int64_t rss;
+            AllocationCounters start;
+        };
+    }  // namespace unit_test
+}  // namespace pensar_digital
+
+#endif // MEMORY_PROBE_HPP
@@ -0,0 +1,213 @@
+#ifndef MEMORY_USAGE_HPP
+#define MEMORY_USAGE_HPP
+
+#include "test_fwd.hpp"
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <new>
+
+/// Allocation accounting.
+///
+/// The counters below are only fed when the global operator new / delete replacements are compiled
+/// in, which is opt-in: define UNIT_TEST_ALLOCATION_HOOKS before including this header in exactly
+/// one translation unit of the test executable. Without them every MemoryUsage reports
+/// tracked = false and CHECK_MAX_ALLOCS / CHECK_NO_ALLOC fail, saying so.
+///
+/// Counters are per thread, so a test only sees what its own thread allocates; memory handed to or
+/// allocated by threads it starts is not attributed to it. MemoryProbe (memory_probe.hpp) turns the
+/// counters into a test's MemoryUsage.
+namespace pensar_digital
+{
+    namespace unit_test
+    {
+        /// Memory activity of one test.
+        struct MemoryUsage
+        {
+            bool     tracked     = false; ///< False when the allocation hooks are not compiled in.
+            uint64_t allocations = 0;     ///< Calls to operator new.
+            uint64_t bytes       = 0;     ///< Bytes requested from operator new.
+            int64_t  peak_bytes  = 0;     ///< Highest live heap size reached, relative to the start.
+            int64_t  rss_delta   = 0;     ///< Change of the process' resident set size, in bytes.
+        };
+
+        /// Running totals of the current thread's heap activity.
+        struct AllocationCounters
+        {
+            uint64_t allocations = 0;
+            uint64_t bytes       = 0;
+            int64_t  live        = 0;
+            int64_t  peak        = 0;
+
+            void on_allocate (size_t requested, size_t usable)
+            {
+                ++allocations;
+                bytes += requested;
+                live  += static_cast<int64_t> (usable);
+                if (live > peak)
+                    peak = live;
+            }
+
+            void on_release (size_t usable) { live -= static_cast<int64_t> (usable); }
+        };
+
+        /// Constant-initialized and trivially destructible, so operator new can use it at any time,
+        /// including during thread start-up and tear-down.
+        inline constinit thread_local AllocationCounters allocation_counters;
+
+        /// Set when the translation unit defining UNIT_TEST_ALLOCATION_HOOKS is linked in.
+        inline std::atomic<bool> allocation_hooks_installed = false;
+
+        /// State of a CHECK_MAX_ALLOCS block: the allocation count when it was entered and its limit.
+        class AllocationBlock
+        {
+            public:
+            explicit AllocationBlock (uint64_t max_allocations) :
+                start (allocation_counters.allocations), max (max_allocations) {}
+
+            /// True on the first call only, so the block's body runs once.
+            bool once () { bool first = !done; done = true; return first; }
+
+            uint64_t count () const { return allocation_counters.allocations - start; }
+            uint64_t limit () const { return max; }
+
+            private:
+            uint64_t start;
+            uint64_t max;
+            bool done = false;
+        };
+
+        /// Checks that a CHECK_MAX_ALLOCS block of t made at most limit allocations. Fails when the
+        /// allocation hooks are not compiled in, as the count would then always be 0.
+        inline bool check_max_allocations (const Test& t, uint64_t actual, uint64_t limit, Text error_message, const Location& where = std::source_location::current ())
+        {
+            if (actual <= limit && allocation_hooks_installed.load (std::memory_order_relaxed)) [[likely]]
+                return true;
+            SStream detail;
+            if (allocation_hooks_installed.load (std::memory_order_relaxed))
+                detail << W("\t actual allocations [") << actual << W("] > [") << limit << W("] allowed");
+            else
+                detail << W("\t allocations are not tracked: define UNIT_TEST_ALLOCATION_HOOKS in one translation unit");
+            t.fail (detail.str (), error_message, where);
+            return false;
+        }
+
+        /// CHECK_MAX_ALLOCS(n) { body } fails when body, run once, calls operator new more than n times.
+        /// Leaving body with break skips the check.
+        #define CHECK_MAX_ALLOCS(max_allocations)                                                      \
+                                  for (AllocationBlock alloc_block_ (max_allocations); alloc_block_.once ();  \
+                                       check_max_allocations (*this, alloc_block_.count (), alloc_block_.limit (), \
+                                       W("CHECK_MAX_ALLOCS")))
+
+        /// CHECK_NO_ALLOC { body } locks in an allocation-free body.
+        #define CHECK_NO_ALLOC                                                                         \
+                                  for (AllocationBlock alloc_block_ (0); alloc_block_.once ();                \
+                                       check_max_allocations (*this, alloc_block_.count (), 0,                    \
+                                       W("CHECK_NO_ALLOC")))
+    }  // namespace unit_test
+}  // namespace pensar_digital
+
+#ifdef UNIT_TEST_ALLOCATION_HOOKS
+
+#if defined(_WIN32)
+    #include <malloc.h>
+#elif defined(__APPLE__)
+    #include <malloc/malloc.h>
+#else
+    #include <malloc.h>
+#endif
+
+namespace pensar_digital
+{
+    namespace unit_test
+    {
+        namespace allocation_hooks
+        {
+            /// Live sizes are taken from the allocator itself, so delete needs no size header.
+            inline size_t usable_size (void* p, size_t alignment = 0) noexcept
+            {
+                #if defined(_WIN32)
+                    return alignment == 0 ? _msize (p) : _aligned_msize (p, alignment, 0);
+                #elif defined(__APPLE__)
+                    (void) alignment;
+                    return malloc_size (p);
+                #else
+                    (void) alignment;
+                    return malloc_usable_size (p);
+                #endif
+            }
+
+            inline void* allocate (size_t n, size_t alignment = 0) noexcept
+            {
+                size_t size = n == 0 ? 1 : n;
+                void* p;
+                #if defined(_WIN32)
+                    p = alignment == 0 ? std::malloc (size) : _aligned_malloc (size, alignment);
+                #else
+                    p = alignment == 0 ? std::malloc (size) : std::aligned_alloc (alignment, (size + alignment - 1) / alignment * alignment);
+                #endif
+                if (p != nullptr)
+                    allocation_counters.on_allocate (n, usable_size (p, alignment));
+                return p;
+            }
+
+            /// operator new's contract: retry through the new handler, throw std::bad_alloc without one.
+            inline void* allocate_or_throw (size_t n, size_t alignment = 0)
+            {
+                for (;;)
+                {
+                    if (void* p = allocate (n, alignment))
+                        return p;
+                    std::new_handler handler = std::get_new_handler ();
+                    if (handler == nullptr)
+                        throw std::bad_alloc ();
+                    handler ();
+                }
+            }
+
+            inline void release (void* p, size_t alignment = 0) noexcept
+            {
+                if (p == nullptr)
+                    return;
+                allocation_counters.on_release (usable_size (p, alignment));
+                #if defined(_WIN32)
+                    alignment == 0 ? std::free (p) : _aligned_free (p);
+                #else
+                    std::free (p);
+                #endif
+            }
+
+            static const bool installed = (allocation_hooks_installed = true);
+        }  // namespace allocation_hooks
+    }  // namespace unit_test
+}  // namespace pensar_digital
+
+namespace pd_hooks = pensar_digital::unit_test::allocation_hooks;
+
+void* operator new   (std::size_t n) { return pd_hooks::allocate_or_throw (n); }
+void* operator new[] (std::size_t n) { return pd_hooks::allocate_or_throw (n); }
+void* operator new   (std::size_t n, const std::nothrow_t&) noexcept { return pd_hooks::allocate (n); }
+void* operator new[] (std::size_t n, const std::nothrow_t&) noexcept { return pd_hooks::allocate (n); }
+void* operator new   (std::size_t n, std::align_val_t a) { return pd_hooks::allocate_or_throw (n, static_cast<size_t> (a)); }
+void* operator new[] (std::size_t n, std::align_val_t a) { return pd_hooks::allocate_or_throw (n, static_cast<size_t> (a)); }
+void* operator new   (std::size_t n, std::align_val_t a, const std::nothrow_t&) noexcept { return pd_hooks::allocate (n, static_cast<size_t> (a)); }
+void* operator new[] (std::size_t n, std::align_val_t a, const std::nothrow_t&) noexcept { return pd_hooks::allocate (n, static_cast<size_t> (a)); }
+
+void operator delete   (void* p) noexcept { pd_hooks::release (p); }
+void operator delete[] (void* p) noexcept { pd_hooks::release (p); }
+void operator delete   (void* p, std::size_t) noexcept { pd_hooks::release (p); }
+void operator delete[] (void* p, std::size_t) noexcept { pd_hooks::release (p); }
+void operator delete   (void* p, const std::nothrow_t&) noexcept { pd_hooks::release (p); }
+void operator delete[] (void* p, const std::nothrow_t&) noexcept { pd_hooks::release (p); }
+void operator delete   (void* p, std::align_val_t a) noexcept { pd_hooks::release (p, static_cast<size_t> (a)); }
+void operator delete[] (void* p, std::align_val_t a) noexcept { pd_hooks::release (p, static_cast<size_t> (a)); }
+void operator delete   (void* p, std::size_t, std::align_val_t a) noexcept { pd_hooks::release (p, static_cast<size_t> (a)); }
+void operator delete[] (void* p, std::size_t, std::align_val_t a) noexcept { pd_hooks::release (p, static_cast<size_t> (a)); }
+void operator delete   (void* p, std::align_val_t a, const std::nothrow_t&) noexcept { pd_hooks::release (p, static_cast<size_t> (a)); }
+void operator delete[] (void* p, std::align_val_t a, const std::nothrow_t&) noexcept { pd_hooks::release (p, static_cast<size_t> (a)); }
+
+#endif // UNIT_TEST_ALLOCATION_HOOKS
+
+#endif // MEMORY_USAGE_HPP
@@ -0,0 +1,13 @@
+// pch.h: This is a precompiled header file.
+// Files listed below are compiled only once, improving build performance for future builds.
+// The unittest library compiles the whole runner through it; a test project can precompile
+// test_fwd.hpp the same way.
+
+#ifndef PCH_H
+#define PCH_H
+
+#include "framework.h"
+
+#include "test.hpp"
+
+#endif //PCH_H
@@ -0,0 +1,275 @@
+#ifndef PERF_COUNTERS_HPP
+#define PERF_COUNTERS_HPP
+
+#include "test_fwd.hpp"
+
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <iomanip>
+#include <ostream>
+
+#ifdef __linux__
+    #include <cerrno>
+    #include <linux/perf_event.h>
+    #include <sys/ioctl.h>
+    #include <sys/syscall.h>
+    #include <unistd.h>
+#endif
+
+namespace pensar_digital
+{
+    namespace unit_test
+    {
+        /// Counter values for one test or region. Only the events whose bit is set in available
+        /// could be counted; the others read 0.
+        struct PerfCounters
+        {
+            enum Event : uint8_t
+            {
+                CYCLES,
+                INSTRUCTIONS,
+                L1D_MISSES,
+                LLC_MISSES,
+                BRANCH_MISSES,
+                TASK_CLOCK,         ///< Nanoseconds the thread was on a CPU.
+                PAGE_FAULTS,
+                CONTEXT_SWITCHES,
+                EVENT_COUNT
+            };
+
+            uint32_t available = 0;
+            uint64_t values[EVENT_COUNT] = {};
+
+            static const char* name (Event e)
+            {
+                static const char* names[EVENT_COUNT] =
+                    { "cycles", "instructions", "L1D misses", "LLC misses", "branch misses", "task-clock ns", "page faults", "context switches" };
+                return names[e];
+            }
+
+            bool collected () const { return available != 0; }
+            bool has (Event e) const { return (available & (1u << e)) != 0; }
+            uint64_t get (Event e) const { return values[e]; }
+
+            /// Instructions per cycle, or 0 when either is unavailable.
+            double ipc () const
+            {
+                return has (CYCLES) && has (INSTRUCTIONS) && values[CYCLES] != 0 ? static_cast<double> (values[INSTRUCTIONS]) / values[CYCLES] : 0;
+            }
+        };
+
+        /// Tab-separated "name value" pairs of the available counters, IPC after instructions.
+        template <typename Char>
+        std::basic_ostream<Char>& operator<< (std::basic_ostream<Char>& os, const PerfCounters& p)
+        {
+            bool first = true;
+            for (uint8_t e = 0; e < PerfCounters::EVENT_COUNT; ++e)
+            {
+                PerfCounters::Event event = static_cast<PerfCounters::Event> (e);
+                if (!p.has (event))
+                    continue;
+                if (!first)
+                    os << Char ('\t');
+                first = false;
+                os << PerfCounters::name (event) << Char (' ') << p.get (event);
+                if (event == PerfCounters::INSTRUCTIONS && p.has (PerfCounters::CYCLES))
+                {
+                    const std::ios_base::fmtflags flags = os.flags ();
+                    const std::streamsize precision = os.precision ();
+                    os << "\tIPC " << std::fixed << std::setprecision (2) << p.ipc ();
+                    os.flags (flags);
+                    os.precision (precision);
+                }
+            }
+            return os;
+        }
+
+        /// Whether run_captured () collects counters around each test. Off by default.
+        inline std::atomic<bool> perf_counters_on = false;
+
+        inline void enable_perf_counters (bool on) { perf_counters_on.store (on, std::memory_order_relaxed); }
+        inline bool perf_counters_enabled () { return perf_counters_on.load (std::memory_order_relaxed); }
+
+        /// Counts the calling thread's events with perf_event_open (Linux only).
+        /// Two groups are opened once per thread and left running: a hardware group (cycles,
+        /// instructions, cache and branch misses) and a software group (task-clock, page faults,
+        /// context switches). Each event that cannot be opened, typically every hardware event in a
+        /// container or VM, is left out, so the software group is the fallback. Measurements are the
+        /// difference between two snapshots, scaled by enabled / running time when the kernel had to
+        /// multiplex the group. Taking a snapshot is one read () per group and never allocates.
+        class PerfCollector
+        {
+            public:
+            struct Snapshot
+            {
+                uint64_t enabled[2] = {};
+                uint64_t running[2] = {};
+                uint64_t values[PerfCounters::EVENT_COUNT] = {};
+            };
+
+            /// The calling thread's collector, reopened after a fork so a child never reads its parent's counters.
+            static PerfCollector& local ()
+            {
+                thread_local PerfCollector collector;
+                #ifdef __linux__
+                    if (collector.owner != getpid ())
+                        collector.open ();
+                #endif
+                return collector;
+            }
+
+            PerfCollector () = default;
+            PerfCollector (const PerfCollector&) = delete;
+            PerfCollector& operator= (const PerfCollector&) = delete;
+            ~PerfCollector () { close (); }
+
+            Snapshot snapshot () const
+            {
+                Snapshot s;
+                #ifdef __linux__
+                    for (size_t g = 0; g < 2; ++g)
+                    {
+                        const Group& group = groups[g];
+                        if (group.size == 0)
+                            continue;
+                        // { nr, time_enabled, time_running, value[nr] }
+                        uint64_t data[3 + PerfCounters::EVENT_COUNT];
+                        if (::read (group.fds[0], data, sizeof (data)) < static_cast<ssize_t> ((3 + group.size) * sizeof (uint64_t)))
+                            continue;
+                        s.enabled[g] = data[1];
+                        s.running[g] = data[2];
+                        for (size_t i = 0; i < group.size && i < data[0]; ++i)
+                            s.values[group.events[i]] = data[3 + i];
+                    }
+                #endif
+                return s;
+            }
+
+            /// Counts between start and now.
+            PerfCounters since (const Snapshot& start) const
+            {
+                Snapshot now = snapshot ();
+                PerfCounters p;
+                for (size_t g = 0; g < 2; ++g)
+                {
+                    const Group& group = groups[g];
+                    uint64_t running = now.running[g] - start.running[g];
+                    uint64_t enabled = now.enabled[g] - start.enabled[g];
+                    if (group.size == 0 || running == 0)
+                        continue;
+                    double scale = static_cast<double> (enabled) / running;
+                    for (size_t i = 0; i < group.size; ++i)
+                    {
+                        PerfCounters::Event e = group.events[i];
+                        p.values[e] = static_cast<uint64_t> ((now.values[e] - start.values[e]) * scale + 0.5);
+                        p.available |= 1u << e;
+                    }
+                }
+                return p;
+            }
+
+            private:
+            struct Group
+            {
+                int fds[PerfCounters::EVENT_COUNT];
+                PerfCounters::Event events[PerfCounters::EVENT_COUNT];
+                size_t size = 0;
+            };
+
+            #ifdef __linux__
+            void open ()
+            {
+                close ();
+                owner = getpid ();
+                add (groups[0], PerfCounters::CYCLES,           PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES);
+                add (groups[0], PerfCounters::INSTRUCTIONS,     PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS);
+                add (groups[0], PerfCounters::L1D_MISSES,       PERF_TYPE_HW_CACHE,
+                     PERF_COUNT_HW_CACHE_L1D | (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16));
+                add (groups[0], PerfCounters::LLC_MISSES,       PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES);
+                add (groups[0], PerfCounters::BRANCH_MISSES,    PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES);
+                add (groups[1], PerfCounters::TASK_CLOCK,       PERF_TYPE_SOFTWARE, PERF_COUNT_SW_TASK_CLOCK);
+                add (groups[1], PerfCounters::PAGE_FAULTS,      PERF_TYPE_SOFTWARE, PERF_COUNT_SW_PAGE_FAULTS);
+                add (groups[1], PerfCounters::CONTEXT_SWITCHES, PERF_TYPE_SOFTWARE, PERF_COUNT_SW_CONTEXT_SWITCHES);
+            }
+
+            /// Opens one event into group. Kernel-side counting is dropped when perf_event_paranoid forbids it.
+            static void add (Group& group, PerfCounters::Event event, uint32_t type, uint64_t config)
+            {
+                perf_event_attr attr;
+                std::memset (&attr, 0, sizeof (attr));
+                attr.size        = sizeof (attr);
+                attr.type        = type;
+                attr.config      = config;
+                attr.exclude_hv  = 1;
+                attr.read_format = PERF_FORMAT_GROUP | PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+                int leader = group.size == 0 ? -1 : group.fds[0];
+                int fd = static_cast<int> (syscall (SYS_perf_event_open, &attr, 0, -1, leader, PERF_FLAG_FD_CLOEXEC));
+                if (fd < 0 && (errno == EACCES || errno == EPERM))
+                {
+                    attr.exclude_kernel = 1;
+                    fd = static_cast<int> (syscall (SYS_perf_event_open, &attr, 0, -1, leader, PERF_FLAG_FD_CLOEXEC));
+                }
+                if (fd < 0)
+                    return;
+                group.fds[group.size] = fd;
+                group.events[group.size] = event;
+                ++group.size;
+            }
+            #endif
+
+            void close ()
+            {
+                #ifdef __linux__
+                    for (Group& group : groups)
+                    {
+                        for (size_t i = group.size; i-- > 0; )
+                            ::close (group.fds[i]);
+                        group.size = 0;
+                    }
+                #endif
+            }
+
+            Group groups[2];
+            #ifdef __linux__
+            pid_t owner = -1;
+            #endif
+        };
+
+        /// Measures the calling thread's counters from construction to stop (). Collects nothing
+        /// unless perf_counters_enabled ().
+        class PerfProbe
+        {
+            public:
+            PerfProbe () : collector (perf_counters_enabled () ? &PerfCollector::local () : nullptr)
+            {
+                if (collector != nullptr)
+                    start = collector->snapshot ();
+            }
+
+            PerfCounters stop () const { return collector == nullptr ? PerfCounters () : collector->since (start); }
+
+            /// True on the first call only; lets PERF_REGION run its body once.
+            bool once () { bool first = !done; done = true; return first; }
+
+            private:
+            PerfCollector* collector;
+            PerfCollector::Snapshot start;
+            bool done = false;
+        };
+
+        /// Writes a PERF_REGION's counters to the test output. Does nothing when none were collected.
+        inline void report_perf_region (Text name, const PerfCounters& p)
+        {
+            if (p.collected ())
+                test_out () << name << W("\t") << p << std::endl;
+        }
+
+        /// PERF_REGION("name") { body } prints the performance counters of body with the test's output.
+        #define PERF_REGION(name)                                                                      \
+                                  for (PerfProbe perf_region_; perf_region_.once ();                          \
+                                       report_perf_region (W(name), perf_region_.stop ()))
+    }  // namespace unit_test
+}  // namespace pensar_digital
+
+#endif // PERF_COUNTERS_HPP
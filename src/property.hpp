@@ -0,0 +1,601 @@
+#ifndef PROPERTY_HPP
+#define PROPERTY_HPP
+
+#include "test_fwd.hpp"
+#include "thread_pool.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <concepts>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <initializer_list>
+#include <iomanip>
+#include <limits>
+#include <memory>
+#include <memory_resource>
+#include <mutex>
+#include <optional>
+#include <random>
+#include <ranges>
+#include <string>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace pensar_digital
+{
+    namespace unit_test
+    {
+        /// SplitMix64: tiny state, so every case gets a generator of its own seeded in one step.
+        class PropertyRng
+        {
+            public:
+            typedef uint64_t result_type;
+
+            explicit PropertyRng (uint64_t seed) : state (seed) {}
+
+            static constexpr result_type min () { return 0; }
+            static constexpr result_type max () { return UINT64_MAX; }
+
+            result_type operator() ()
+            {
+                uint64_t z = (state += 0x9E3779B97F4A7C15ull);
+                z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+                z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+                return z ^ (z >> 31);
+            }
+
+            private:
+            uint64_t state;
+        };
+
+        /// What a generator draws from: the case's random numbers, its size (how large strings and
+        /// containers may grow; it cycles from 0 to the property's max size over the cases) and the
+        /// case's arena, which generated strings and containers allocate from.
+        struct GenContext
+        {
+            PropertyRng rng;
+            size_t size;
+            std::pmr::memory_resource* arena;
+
+            /// Uniform in [0, n); n = 0 means the full 64-bit range.
+            uint64_t random (uint64_t n) { return n == 0 ? rng () : rng () % n; }
+            bool one_in (uint64_t n) { return random (n) == 0; }
+        };
+
+        /// Generators: objects with a value_type, a const operator () (GenContext&) drawing a value,
+        /// and a const shrink (value, std::vector<value_type>& out) appending simpler candidates,
+        /// simplest first. Strings and containers are std::pmr types built on the case's arena.
+        namespace gen
+        {
+            template <std::integral T>
+            struct Integer
+            {
+                typedef T value_type;
+
+                T lo = std::numeric_limits<T>::min ();
+                T hi = std::numeric_limits<T>::max ();
+
+                /// Mostly small values, growing with the size, then uniform ones and the range's edges.
+                T operator() (GenContext& c) const
+                {
+                    switch (c.random (8))
+                    {
+                        case 0: return c.one_in (2) ? lo : hi;
+                        case 1: return in_range (0) ? T (0) : lo;
+                        case 2: case 3: return pick (c, lo, hi);
+                        default:
+                        {
+                            const uint64_t target = static_cast<uint64_t> (simplest ());
+                            const uint64_t reach  = c.size + 1;
+                            T from = static_cast<T> (target - std::min (reach, target - static_cast<uint64_t> (lo)));
+                            T to   = static_cast<T> (target + std::min (reach, static_cast<uint64_t> (hi) - target));
+                            return pick (c, from, to);
+                        }
+                    }
+                }
+
+                /// Toward 0, or toward the bound nearest to it: the target itself, then v moved by half the
+                /// distance, a quarter, ... down to one step.
+                void shrink (T v, std::vector<T>& out) const
+                {
+                    T target = simplest ();
+                    if (v == target)
+                        return;
+                    bool up = v < target;
+                    uint64_t distance = up ? static_cast<uint64_t> (target) - static_cast<uint64_t> (v) : static_cast<uint64_t> (v) - static_cast<uint64_t> (target);
+                    out.push_back (target);
+                    for (uint64_t d = distance / 2; d > 0; d /= 2)
+                        out.push_back (static_cast<T> (up ? static_cast<uint64_t> (v) + d : static_cast<uint64_t> (v) - d));
+                }
+
+                private:
+                bool in_range (T v) const { return lo <= v && v <= hi; }
+                T simplest () const { return in_range (0) ? T (0) : (lo > 0 ? lo : hi); }
+
+                static T pick (GenContext& c, T from, T to)
+                {
+                    uint64_t span = static_cast<uint64_t> (to) - static_cast<uint64_t> (from) + 1;
+                    return static_cast<T> (static_cast<uint64_t> (from) + c.random (span));
+                }
+            };
+
+            template <std::floating_point T>
+            struct Real
+            {
+                typedef T value_type;
+
+                T lo = -1e6;
+                T hi =  1e6;
+
+                T operator() (GenContext& c) const
+                {
+                    switch (c.random (8))
+                    {
+                        case 0: return c.one_in (2) ? lo : hi;
+                        case 1: return lo <= 0 && 0 <= hi ? T (0) : lo;
+                        case 2: return std::clamp (std::numeric_limits<T>::denorm_min (), lo, hi);
+                        default:
+                            return lo + (hi - lo) * static_cast<T> (static_cast<double> (c.rng () >> 11) * 0x1.0p-53);
+                    }
+                }
+
+                /// Toward 0 (or lo): the target, the value truncated, then halved.
+                void shrink (T v, std::vector<T>& out) const
+                {
+                    T target = lo <= 0 && 0 <= hi ? T (0) : lo;
+                    if (v == target || v != v)
+                        return;
+                    out.push_back (target);
+                    T t = std::trunc (v);
+                    if (t != v && lo <= t && t <= hi)
+                        out.push_back (t);
+                    T half = target + (v - target) / 2;
+                    if (half != v && half != target && half != t)
+                        out.push_back (half);
+                }
+            };
+
+            /// Shrinks a sequence by removing halves, quarters, ... and single elements, then by
+            /// shrinking its first elements in place.
+            template <typename Seq, typename ElementGen>
+            void shrink_sequence (const Seq& v, const ElementGen& element, std::vector<Seq>& out)
+            {
+                const size_t n = v.size ();
+                if (n == 0)
+                    return;
+                out.emplace_back ();
+                for (size_t chunk = n / 2; chunk > 0; chunk /= 2)
+                    for (size_t at = 0; at + chunk <= n; at += chunk)
+                    {
+                        Seq shorter;
+                        shorter.reserve (n - chunk);
+                        shorter.insert (shorter.end (), v.begin (), v.begin () + at);
+                        shorter.insert (shorter.end (), v.begin () + at + chunk, v.end ());
+                        out.push_back (std::move (shorter));
+                    }
+                std::vector<typename ElementGen::value_type> simpler;
+                for (size_t i = 0; i < n && i < 8; ++i)
+                {
+                    simpler.clear ();
+                    element.shrink (v[i], simpler);
+                    for (auto& e : simpler)
+                    {
+                        out.push_back (Seq (v));
+                        out.back ()[i] = std::move (e);
+                    }
+                }
+            }
+
+            template <typename CharGen = Integer<char>>
+            struct String
+            {
+                typedef std::pmr::string value_type;
+
+                CharGen chars;
+                size_t max_length = SIZE_MAX;
+
+                value_type operator() (GenContext& c) const
+                {
+                    value_type s (c.arena);
+                    size_t length = c.random (std::min (c.size, max_length) + 1);
+                    s.reserve (length);
+                    for (size_t i = 0; i < length; ++i)
+                        s.push_back (chars (c));
+                    return s;
+                }
+
+                void shrink (const value_type& v, std::vector<value_type>& out) const { shrink_sequence (v, chars, out); }
+            };
+
+            template <typename ElementGen>
+            struct VectorOf
+            {
+                typedef std::pmr::vector<typename ElementGen::value_type> value_type;
+
+                ElementGen element;
+                size_t max_length = SIZE_MAX;
+
+                value_type operator() (GenContext& c) const
+                {
+                    value_type v (c.arena);
+                    size_t length = c.random (std::min (c.size, max_length) + 1);
+                    v.reserve (length);
+                    for (size_t i = 0; i < length; ++i)
+                        v.push_back (element (c));
+                    return v;
+                }
+
+                void shrink (const value_type& v, std::vector<value_type>& out) const { shrink_sequence (v, element, out); }
+            };
+
+            /// Values of g passed through f. Not shrunk: f cannot be inverted.
+            template <typename G, typename F>
+            struct Map
+            {
+                typedef std::decay_t<std::invoke_result_t<const F&, typename G::value_type>> value_type;
+
+                G g;
+                F f;
+
+                value_type operator() (GenContext& c) const { return f (g (c)); }
+                void shrink (const value_type&, std::vector<value_type>&) const {}
+            };
+
+            /// One of a fixed set of values, shrinking toward the first.
+            template <typename T>
+            struct ElementOf
+            {
+                typedef T value_type;
+
+                std::vector<T> values;
+
+                T operator() (GenContext& c) const { return values[c.random (values.size ())]; }
+
+                void shrink (const T& v, std::vector<T>& out) const
+                {
+                    for (const T& candidate : values)
+                    {
+                        if (candidate == v)
+                            return;
+                        out.push_back (candidate);
+                    }
+                }
+            };
+
+            template <std::integral T = int>
+            Integer<T> integer (T lo = std::numeric_limits<T>::min (), T hi = std::numeric_limits<T>::max ()) { return { lo, hi }; }
+
+            template <std::floating_point T = double>
+            Real<T> real (T lo = -1e6, T hi = 1e6) { return { lo, hi }; }
+
+            /// Printable ASCII strings.
+            inline String<> string (size_t max_length = SIZE_MAX) { return { Integer<char> { ' ', '~' }, max_length }; }
+
+            template <typename CharGen>
+            String<CharGen> string_of (CharGen chars, size_t max_length = SIZE_MAX) { return { std::move (chars), max_length }; }
+
+            template <typename ElementGen>
+            VectorOf<ElementGen> vector_of (ElementGen element, size_t max_length = SIZE_MAX) { return { std::move (element), max_length }; }
+
+            template <typename G, typename F>
+            Map<G, F> map (G g, F f) { return { std::move (g), std::move (f) }; }
+
+            template <typename T>
+            ElementOf<T> element_of (std::initializer_list<T> values) { return { std::vector<T> (values) }; }
+        }  // namespace gen
+
+        /// Writes a generated value: numbers as such, characters and strings quoted and escaped,
+        /// other ranges in brackets.
+        template <typename T>
+        void write_value (std::basic_ostream<C>& os, const T& v)
+        {
+            auto write_char = [&os](char ch)
+            {
+                unsigned char u = static_cast<unsigned char> (ch);
+                if (ch == '"' || ch == '\\')
+                    os << C ('\\') << C (ch);
+                else if (u >= 32 && u < 127)
+                    os << C (ch);
+                else
+                {
+                    const C fill = os.fill (C ('0'));
+                    os << W("\\x") << std::hex << std::setw (2) << static_cast<unsigned> (u) << std::dec;
+                    os.fill (fill);
+                }
+            };
+            if constexpr (std::is_same_v<T, char>)
+            {
+                os << C ('\'');
+                write_char (v);
+                os << C ('\'');
+            }
+            else if constexpr (std::is_floating_point_v<T>)
+            {
+                std::streamsize precision = os.precision (std::numeric_limits<T>::max_digits10);
+                os << v;
+                os.precision (precision);
+            }
+            else if constexpr (std::is_arithmetic_v<T>)
+                os << +v;
+            else if constexpr (std::ranges::range<T> && std::is_same_v<std::ranges::range_value_t<T>, char>)
+            {
+                os << C ('"');
+                for (char ch : v)
+                    write_char (ch);
+                os << C ('"');
+            }
+            else if constexpr (std::ranges::range<T>)
+            {
+                os << C ('[');
+                bool first = true;
+                for (const auto& e : v)
+                {
+                    if (!first)
+                        os << W(", ");
+                    first = false;
+                    write_value (os, e);
+                }
+                os << C (']');
+            }
+            else if constexpr (requires { os << v; })
+                os << v;
+            else
+                os << W("<value>");
+        }
+
+        /// Settings and reporting shared by all properties, whatever their generators.
+        class PropertyBase : public Test
+        {
+            public:
+            inline static uint64_t DEFAULT_CASES    = 10000;
+            inline static size_t   DEFAULT_MAX_SIZE = 100;
+            inline static size_t   DEFAULT_WORKERS  = 0;   ///< 0: one per hardware thread.
+            static constexpr size_t CASES_PER_SHARD  = 1024;
+            static constexpr size_t ARENA_BYTES      = 64 << 10;
+            static constexpr size_t MAX_SHRINK_STEPS = 10000;
+
+            /// Seed every property uses instead of a random one when not 0. Set by --property-seed S.
+            inline static std::atomic<uint64_t> seed_override = 0;
+
+            PropertyBase (const S& name, const std::source_location& where) : Test (name, NULL_ID, UNORDERED, true, true, where), line (where.line ()) {}
+
+            PropertyBase& set_cases    (uint64_t n) { cases    = n; return *this; }
+            PropertyBase& set_max_size (size_t n  ) { max_size = n; return *this; }
+            PropertyBase& set_workers  (size_t n  ) { workers  = n; return *this; }
+            /// Seed of the next runs; 0 draws a new one per run unless --property-seed is given.
+            PropertyBase& set_seed     (uint64_t s) { seed     = s; return *this; }
+
+            uint64_t get_cases     () const { return cases    == 0 ? DEFAULT_CASES    : cases;    }
+            size_t   get_max_size  () const { return max_size == 0 ? DEFAULT_MAX_SIZE : max_size; }
+            size_t   get_workers   () const { return workers  == 0 ? (DEFAULT_WORKERS == 0 ? WorkStealingPool::default_worker_count () : DEFAULT_WORKERS) : workers; }
+            /// Seed of the last run.
+            uint64_t get_last_seed () const { return last_seed; }
+
+            protected:
+            uint64_t choose_seed ()
+            {
+                uint64_t s = seed != 0 ? seed : seed_override.load (std::memory_order_relaxed);
+                while (s == 0)
+                    s = (uint64_t (std::random_device () ()) << 32) | std::random_device () ();
+                return last_seed = s;
+            }
+
+            /// Seed of case i: the run's seed mixed with i, so each case can be generated on any thread.
+            static uint64_t case_seed (uint64_t run_seed, uint64_t i) { return PropertyRng (run_seed ^ (i * 0xD1B54A32D192ED03ull)) (); }
+
+            void report_throughput (uint64_t run, int64_t nanoseconds, uint64_t run_seed) const
+            {
+                std::basic_ostream<C>& os = test_out ();
+                const std::ios_base::fmtflags flags = os.flags ();
+                const std::streamsize precision = os.precision ();
+                os << get_name () << W("\t") << run << W(" cases in ") << nanoseconds / 1000000 << W(" ms\t")
+                   << std::fixed << std::setprecision (0) << (nanoseconds > 0 ? run * 1e9 / nanoseconds : 0.0) << W(" cases/s");
+                os.flags (flags);
+                os.precision (precision);
+                os << W("\tseed ") << run_seed << std::endl;
+            }
+
+            /// Line the property is declared on, for the Failure of a falsified property.
+            const unsigned line;
+
+            private:
+            uint64_t cases    = 0;
+            size_t   max_size = 0;
+            size_t   workers  = 0;
+            uint64_t seed     = 0;
+            uint64_t last_seed = 0;
+        };
+
+        template <typename Derived, typename Generators>
+        class Property;
+
+        /// Property checks Derived::holds (values...) on get_cases () inputs drawn from the generators.
+        /// Cases are generated in shards of CASES_PER_SHARD on a WorkStealingPool; each shard reuses one
+        /// arena, reset after every case, so generating an input costs no heap allocation unless it
+        /// outgrows ARENA_BYTES. A case fails when holds returns false, a check in it fails or it
+        /// throws. The failing case with the lowest index is shrunk on the calling thread, one
+        /// argument at a time, to a minimal counterexample, which is run once more with its output
+        /// kept and printed with the seed that replays the run.
+        template <typename Derived, typename... G>
+        class Property<Derived, std::tuple<G...>> : public PropertyBase
+        {
+            public:
+            typedef std::tuple<typename G::value_type...> Values;
+
+            Property (const S& name, std::tuple<G...> agenerators, const std::source_location& where = std::source_location::current ()) :
+                PropertyBase (name, where), generators (std::move (agenerators)) {}
+
+            bool run ()
+            {
+                const uint64_t run_seed = choose_seed ();
+                const uint64_t case_count = get_cases ();
+                const size_t size_cycle = get_max_size () + 1;
+                const bool stop = get_stop_on_failure ();
+                set_stop_on_failure (true);
+                std::basic_ostream<C>* const output = test_stream;
+
+                std::atomic<uint64_t> first_failure (UINT64_MAX);
+                std::atomic<uint64_t> run_cases (0);
+                std::mutex failure_mutex;
+                std::optional<Values> counterexample;
+                std::atomic<bool> never_cancelled (false);
+                const std::chrono::steady_clock::time_point t0 = std::chrono::steady_clock::now ();
+                WorkStealingPool pool (get_workers ());
+                pool.run ((case_count + CASES_PER_SHARD - 1) / CASES_PER_SHARD, [&](size_t shard)
+                {
+                    const uint64_t begin = shard * CASES_PER_SHARD;
+                    const uint64_t end   = std::min<uint64_t> (case_count, begin + CASES_PER_SHARD);
+                    if (begin > first_failure.load (std::memory_order_relaxed))
+                        return;
+                    SStream scratch;
+                    std::basic_ostream<C>* const saved = test_stream;
+                    test_stream = &scratch;
+                    std::unique_ptr<std::byte[]> buffer (new std::byte[ARENA_BYTES]);
+                    std::pmr::monotonic_buffer_resource arena (buffer.get (), ARENA_BYTES);
+                    uint64_t i = begin;
+                    for (; i < end && i < first_failure.load (std::memory_order_relaxed); ++i)
+                    {
+                        {
+                            Values values = generate (case_seed (run_seed, i), i % size_cycle, &arena);
+                            if (!holds_for (values))
+                            {
+                                std::lock_guard<std::mutex> lock (failure_mutex);
+                                if (i < first_failure.load (std::memory_order_relaxed))
+                                {
+                                    first_failure.store (i, std::memory_order_relaxed);
+                                    counterexample.emplace (values);
+                                }
+                                ++i;
+                                break;
+                            }
+                        }
+                        arena.release ();
+                    }
+                    run_cases.fetch_add (i - begin, std::memory_order_relaxed);
+                    test_stream = saved;
+                }, never_cancelled);
+                const int64_t nanoseconds = std::chrono::duration_cast<std::chrono::nanoseconds> (std::chrono::steady_clock::now () - t0).count ();
+                report_throughput (run_cases.load (), nanoseconds, run_seed);
+                if (!counterexample)
+                {
+                    set_stop_on_failure (stop);
+                    return true;
+                }
+
+                SStream scratch;
+                test_stream = &scratch;
+                size_t steps = 0;
+                size_t shrinks = 0;
+                while (steps < MAX_SHRINK_STEPS && shrink_step (*counterexample, steps, std::index_sequence_for<G...> ()))
+                    ++shrinks;
+                test_stream = output;
+                holds_for (*counterexample);
+                set_stop_on_failure (stop);
+
+                std::basic_ostream<C>& os = test_out ();
+                os << get_name () << W(" falsified by case ") << first_failure.load () << W("; counterexample after ") << shrinks << W(" shrinks: (");
+                std::apply ([&os](const auto&... v)
+                {
+                    bool first = true;
+                    ((os << (first ? W("") : W(", ")), write_value (os, v), first = false), ...);
+                }, *counterexample);
+                os << W("); replay with --property-seed ") << run_seed << std::endl;
+                if (stop)
+                {
+                    const char* file = get_source_file ();
+                    throw Failure (pd::Object::id (), get_name (), W("property falsified"), S (file, file + std::strlen (file)), line);
+                }
+                return false;
+            }
+
+            private:
+            Values generate (uint64_t seed, size_t size, std::pmr::memory_resource* arena) const
+            {
+                GenContext c { PropertyRng (seed), size, arena };
+                // Braced initialization evaluates the generators left to right, so a seed always gives the same values.
+                return std::apply ([&c](const G&... g) { return Values { g (c)... }; }, generators);
+            }
+
+            /// True when the property holds for values. An exception is written to the test output.
+            bool holds_for (const Values& values)
+            {
+                try
+                {
+                    return std::apply ([this](const auto&... v) { return static_cast<Derived*> (this)->holds (v...); }, values);
+                }
+                catch (const Failure&)
+                {
+                }
+                catch (const std::exception& e)
+                {
+                    test_out () << get_name () << W(" threw an unexpected exception: ") << e.what () << std::endl;
+                }
+                catch (...)
+                {
+                    test_out () << get_name () << W(" threw an unexpected exception.") << std::endl;
+                }
+                return false;
+            }
+
+            /// Replaces best with the first simpler candidate that still fails, trying the arguments
+            /// in order. False when none does.
+            template <size_t... K>
+            bool shrink_step (Values& best, size_t& steps, std::index_sequence<K...>)
+            {
+                return (shrink_argument<K> (best, steps) || ...);
+            }
+
+            template <size_t K>
+            bool shrink_argument (Values& best, size_t& steps)
+            {
+                std::vector<std::tuple_element_t<K, Values>> candidates;
+                std::get<K> (generators).shrink (std::get<K> (best), candidates);
+                for (auto& candidate : candidates)
+                {
+                    if (steps++ >= MAX_SHRINK_STEPS)
+                        return false;
+                    Values trial (best);
+                    std::get<K> (trial) = std::move (candidate);
+                    if (!holds_for (trial))
+                    {
+                        best = std::move (trial);
+                        return true;
+                    }
+                }
+                return false;
+            }
+
+            std::tuple<G...> generators;
+        };
+
+        /// PROPERTY(name, (parameters), generator...) body PROPERTY_END(name) declares a property: body
+        /// must hold for every input the generators draw, passed as parameters. It may use the CHECK
+        /// macros or return false. Example:
+        ///
+        ///     PROPERTY(ReverseTwice, (const std::pmr::string& s), gen::string ())
+        ///         CHECK(reverse (reverse (s)) == s, W("reverse twice"))
+        ///     PROPERTY_END(ReverseTwice)
+        #define PROPERTY(name, parameters, ...) \
+                      inline auto property_generators_##name () { return std::make_tuple (__VA_ARGS__); } \
+                      class Property##name : public Property<Property##name, decltype (property_generators_##name ())> \
+                      {                                            \
+                        public:                                    \
+                        inline static const Version VERSION = Version (1, 1, 1); \
+                        Property##name ()                          \
+                        : Property (W(#name), property_generators_##name ()){enlist ();};    \
+                        bool holds parameters                      \
+                        {
+
+        #define PROPERTY_END(name)                                       \
+                        return true; }                             \
+                      }; Property ## name property_ ## name;
+    }  // namespace unit_test
+}  // namespace pensar_digital
+
+#endif // PROPERTY_HPP
@@ -0,0 +1,274 @@
+#ifndef RANGE_COMPARE_HPP
+#define RANGE_COMPARE_HPP
+
+#include <algorithm>
+#include <bit>
+#include <cmath>
+#include <concepts>
+#include <cstddef>
+#include <cstring>
+
+/// Vectorized range comparison. Compiled into the unittest library (test.cpp), behind the
+/// first_mismatch / first_outside declared in test_fwd.hpp, so test translation units never see
+/// the intrinsics headers.
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+    #define UNIT_TEST_X86 1
+    #ifdef _MSC_VER
+        #include <intrin.h>
+    #else
+        #include <cpuid.h>
+    #endif
+    #include <immintrin.h>
+    #if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+        #define UNIT_TEST_SSE2 1
+    #endif
+    #if defined(__GNUC__) || defined(__clang__)
+        #define UNIT_TEST_TARGET_AVX2 __attribute__ ((target ("avx2")))
+    #else
+        #define UNIT_TEST_TARGET_AVX2
+    #endif
+#endif
+
+namespace pensar_digital
+{
+    namespace unit_test
+    {
+        /// Instruction set the kernels below dispatch to, detected once per process.
+        enum class Isa { SCALAR, SSE2, AVX2 };
+
+        inline Isa detect_isa ()
+        {
+            #ifdef UNIT_TEST_X86
+                bool avx2 = false;
+                #ifdef _MSC_VER
+                    int r[4];
+                    __cpuid (r, 0);
+                    if (r[0] >= 7)
+                    {
+                        __cpuid (r, 1);
+                        bool os_saves_ymm = (r[2] & (1 << 27)) != 0 && (r[2] & (1 << 28)) != 0 && (_xgetbv (0) & 6) == 6;
+                        __cpuidex (r, 7, 0);
+                        avx2 = os_saves_ymm && (r[1] & (1 << 5)) != 0;
+                    }
+                #else
+                    __builtin_cpu_init ();
+                    avx2 = __builtin_cpu_supports ("avx2");
+                #endif
+                if (avx2)
+                    return Isa::AVX2;
+                #ifdef UNIT_TEST_SSE2
+                    return Isa::SSE2;
+                #endif
+            #endif
+            return Isa::SCALAR;
+        }
+
+        inline Isa isa ()
+        {
+            static const Isa detected = detect_isa ();
+            return detected;
+        }
+
+        namespace kernel
+        {
+            /// Tolerance test shared by every kernel. NaN never compares within tolerance.
+            template <std::floating_point T>
+            inline bool within (T a, T b, T delta, T relative_delta)
+            {
+                T diff = std::abs (a - b);
+                return diff < delta || diff <= relative_delta * std::max (std::abs (a), std::abs (b));
+            }
+
+            inline size_t first_mismatch_scalar (const unsigned char* a, const unsigned char* b, size_t n)
+            {
+                size_t i = 0;
+                for (; i + 64 <= n && std::memcmp (a + i, b + i, 64) == 0; i += 64) {}
+                for (; i < n && a[i] == b[i]; ++i) {}
+                return i;
+            }
+
+            template <std::floating_point T>
+            inline size_t first_outside_scalar (const T* a, const T* b, size_t n, T delta, T relative_delta)
+            {
+                size_t i = 0;
+                for (; i < n && within (a[i], b[i], delta, relative_delta); ++i) {}
+                return i;
+            }
+
+            #ifdef UNIT_TEST_SSE2
+            inline size_t first_mismatch_sse2 (const unsigned char* a, const unsigned char* b, size_t n)
+            {
+                size_t i = 0;
+                for (; i + 16 <= n; i += 16)
+                {
+                    __m128i eq = _mm_cmpeq_epi8 (_mm_loadu_si128 (reinterpret_cast<const __m128i*> (a + i)),
+                                                 _mm_loadu_si128 (reinterpret_cast<const __m128i*> (b + i)));
+                    unsigned diff = ~static_cast<unsigned> (_mm_movemask_epi8 (eq)) & 0xFFFFu;
+                    if (diff != 0)
+                        return i + std::countr_zero (diff);
+                }
+                return i + first_mismatch_scalar (a + i, b + i, n - i);
+            }
+
+            inline size_t first_outside_sse2 (const float* a, const float* b, size_t n, float delta, float relative_delta)
+            {
+                const __m128 sign = _mm_set1_ps (-0.0f);
+                const __m128 d    = _mm_set1_ps (delta);
+                const __m128 r    = _mm_set1_ps (relative_delta);
+                size_t i = 0;
+                for (; i + 4 <= n; i += 4)
+                {
+                    __m128 va   = _mm_andnot_ps (sign, _mm_loadu_ps (a + i));
+                    __m128 vb   = _mm_andnot_ps (sign, _mm_loadu_ps (b + i));
+                    __m128 diff = _mm_andnot_ps (sign, _mm_sub_ps (_mm_loadu_ps (a + i), _mm_loadu_ps (b + i)));
+                    __m128 ok   = _mm_or_ps (_mm_cmplt_ps (diff, d), _mm_cmple_ps (diff, _mm_mul_ps (r, _mm_max_ps (va, vb))));
+                    unsigned bad = ~static_cast<unsigned> (_mm_movemask_ps (ok)) & 0xFu;
+                    if (bad != 0)
+                        return i + std::countr_zero (bad);
+                }
+                return i + first_outside_scalar (a + i, b + i, n - i, delta, relative_delta);
+            }
+
+            inline size_t first_outside_sse2 (const double* a, const double* b, size_t n, double delta, double relative_delta)
+            {
+                const __m128d sign = _mm_set1_pd (-0.0);
+                const __m128d d    = _mm_set1_pd (delta);
+                const __m128d r    = _mm_set1_pd (relative_delta);
+                size_t i = 0;
+                for (; i + 2 <= n; i += 2)
+                {
+                    __m128d va   = _mm_andnot_pd (sign, _mm_loadu_pd (a + i));
+                    __m128d vb   = _mm_andnot_pd (sign, _mm_loadu_pd (b + i));
+                    __m128d diff = _mm_andnot_pd (sign, _mm_sub_pd (_mm_loadu_pd (a + i), _mm_loadu_pd (b + i)));
+                    __m128d ok   = _mm_or_pd (_mm_cmplt_pd (diff, d), _mm_cmple_pd (diff, _mm_mul_pd (r, _mm_max_pd (va, vb))));
+                    unsigned bad = ~static_cast<unsigned> (_mm_movemask_pd (ok)) & 0x3u;
+                    if (bad != 0)
+                        return i + std::countr_zero (bad);
+                }
+                return i + first_outside_scalar (a + i, b + i, n - i, delta, relative_delta);
+            }
+            #endif
+
+            #ifdef UNIT_TEST_X86
+            UNIT_TEST_TARGET_AVX2 inline size_t first_mismatch_avx2 (const unsigned char* a, const unsigned char* b, size_t n)
+            {
+                size_t i = 0;
+                for (; i + 32 <= n; i += 32)
+                {
+                    __m256i eq = _mm256_cmpeq_epi8 (_mm256_loadu_si256 (reinterpret_cast<const __m256i*> (a + i)),
+                                                    _mm256_loadu_si256 (reinterpret_cast<const __m256i*> (b + i)));
+                    unsigned diff = ~static_cast<unsigned> (_mm256_movemask_epi8 (eq));
+                    if (diff != 0)
+                        return i + std::countr_zero (diff);
+                }
+                return i + first_mismatch_scalar (a + i, b + i, n - i);
+            }
+
+            UNIT_TEST_TARGET_AVX2 inline size_t first_outside_avx2 (const float* a, const float* b, size_t n, float delta, float relative_delta)
+            {
+                const __m256 sign = _mm256_set1_ps (-0.0f);
+                const __m256 d    = _mm256_set1_ps (delta);
+                const __m256 r    = _mm256_set1_ps (relative_delta);
+                size_t i = 0;
+                for (; i + 8 <= n; i += 8)
+                {
+                    __m256 xa   = _mm256_loadu_ps (a + i);
+                    __m256 xb   = _mm256_loadu_ps (b + i);
+                    __m256 diff = _mm256_andnot_ps (sign, _mm256_sub_ps (xa, xb));
+                    __m256 bound = _mm256_mul_ps (r, _mm256_max_ps (_mm256_andnot_ps (sign, xa), _mm256_andnot_ps (sign, xb)));
+                    __m256 ok   = _mm256_or_ps (_mm256_cmp_ps (diff, d, _CMP_LT_OQ), _mm256_cmp_ps (diff, bound, _CMP_LE_OQ));
+                    unsigned bad = ~static_cast<unsigned> (_mm256_movemask_ps (ok)) & 0xFFu;
+                    if (bad != 0)
+                        return i + std::countr_zero (bad);
+                }
+                return i + first_outside_scalar (a + i, b + i, n - i, delta, relative_delta);
+            }
+
+            UNIT_TEST_TARGET_AVX2 inline size_t first_outside_avx2 (const double* a, const double* b, size_t n, double delta, double relative_delta)
+            {
+                const __m256d sign = _mm256_set1_pd (-0.0);
+                const __m256d d    = _mm256_set1_pd (delta);
+                const __m256d r    = _mm256_set1_pd (relative_delta);
+                size_t i = 0;
+                for (; i + 4 <= n; i += 4)
+                {
+                    __m256d xa   = _mm256_loadu_pd (a + i);
+                    __m256d xb   = _mm256_loadu_pd (b + i);
+                    __m256d diff = _mm256_andnot_pd (sign, _mm256_sub_pd (xa, xb));
+                    __m256d bound = _mm256_mul_pd (r, _mm256_max_pd (_mm256_andnot_pd (sign, xa), _mm256_andnot_pd (sign, xb)));
+                    __m256d ok   = _mm256_or_pd (_mm256_cmp_pd (diff, d, _CMP_LT_OQ), _mm256_cmp_pd (diff, bound, _CMP_LE_OQ));
+                    unsigned bad = ~static_cast<unsigned> (_mm256_movemask_pd (ok)) & 0xFu;
+                    if (bad != 0)
+                        return i + std::countr_zero (bad);
+                }
+                return i + first_outside_scalar (a + i, b + i, n - i, delta, relative_delta);
+            }
+            #endif
+        }  // namespace kernel
+
+        /// Index of the first element where a and b differ, or n when all n elements are equal.
+        /// T must be comparable bitwise.
+        template <typename T>
+        inline size_t first_mismatch (const T* a, const T* b, size_t n)
+        {
+            const unsigned char* x = reinterpret_cast<const unsigned char*> (a);
+            const unsigned char* y = reinterpret_cast<const unsigned char*> (b);
+            size_t bytes = n * sizeof (T);
+            size_t i;
+            switch (isa ())
+            {
+                #ifdef UNIT_TEST_X86
+                case Isa::AVX2: i = kernel::first_mismatch_avx2 (x, y, bytes); break;
+                #endif
+                #ifdef UNIT_TEST_SSE2
+                case Isa::SSE2: i = kernel::first_mismatch_sse2 (x, y, bytes); break;
+                #endif
+                default:        i = kernel::first_mismatch_scalar (x, y, bytes); break;
+            }
+            return i / sizeof (T);
+        }
+
+        /// Index of the first element where |a - b| < delta and |a - b| <= relative_delta * max (|a|, |b|)
+        /// both fail, or n when every element is within tolerance.
+        template <std::floating_point T>
+        inline size_t first_mismatch (const T* a, const T* b, size_t n, T delta, T relative_delta)
+        {
+            if constexpr (std::same_as<T, float> || std::same_as<T, double>)
+            {
+                switch (isa ())
+                {
+                    #ifdef UNIT_TEST_X86
+                    case Isa::AVX2: return kernel::first_outside_avx2 (a, b, n, delta, relative_delta);
+                    #endif
+                    #ifdef UNIT_TEST_SSE2
+                    case Isa::SSE2: return kernel::first_outside_sse2 (a, b, n, delta, relative_delta);
+                    #endif
+                    default: break;
+                }
+            }
+            return kernel::first_outside_scalar (a, b, n, delta, relative_delta);
+        }
+
+        /// Number of differing elements in [from, n). Only used to report a failure, so it stays scalar.
+        template <typename T>
+        inline size_t count_mismatches (const T* a, const T* b, size_t from, size_t n)
+        {
+            size_t count = 0;
+            for (size_t i = from; i < n; ++i)
+                count += std::memcmp (a + i, b + i, sizeof (T)) != 0;
+            return count;
+        }
+
+        template <std::floating_point T>
+        inline size_t count_mismatches (const T* a, const T* b, size_t from, size_t n, T delta, T relative_delta)
+        {
+            size_t count = 0;
+            for (size_t i = from; i < n; ++i)
+                count += !kernel::within (a[i], b[i], delta, relative_delta);
+            return count;
+        }
+    }  // namespace unit_test
+}  // namespace pensar_digital
+
+#endif // RANGE_COMPARE_HPP
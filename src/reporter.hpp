@@ -0,0 +1,619 @@
+#ifndef REPORTER_HPP
+#define REPORTER_HPP
+
+#include "../../cpplib/src/constant.hpp"
+#include "../../cpplib/src/string_def.hpp"
+#include "../../cpplib//src/s.hpp"
+
+#include "memory_usage.hpp"
+#include "perf_counters.hpp"
+
+#include <atomic>
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <thread>
+#include <utility>
+#include <vector>
+
+namespace pensar_digital
+{
+    namespace pd = pensar_digital::cpplib;
+    namespace unit_test
+    {
+        using namespace cpplib;
+
+        /// Structured event CompositeTest::run emits for each step of a run.
+        struct TestEvent
+        {
+            enum Kind : uint8_t
+            {
+                RUN_START,  ///< name is the suite, count the number of tests, reason the shuffle seed if any.
+                TEST_START,
+                TEST_PASS,
+                TEST_FAIL,
+                TEST_SKIP,  ///< reason says why: disabled or cancelled.
+                RUN_END,    ///< ok is the suite result, elapsed / nanoseconds its duration.
+                FIXTURE,    ///< Sent before RUN_END for each fixture set up: count set-ups taking nanoseconds in all.
+                ITERATION   ///< Sent before each iteration of a repeated run: number of count, reason the iteration / shuffle seed.
+            };
+
+            Kind    kind        = RUN_START;
+            bool    ok          = true;
+            size_t  number      = 0;   ///< Countdown number the console shows next to the test.
+            size_t  count       = 0;
+            int64_t nanoseconds = 0;
+            Id      id          = NULL_ID; ///< Id of the test, for test events.
+            S       name;
+            S       elapsed;
+            S       output;            ///< Everything the test wrote, including check failures.
+            S       reason;
+            MemoryUsage memory;        ///< Heap activity of the test, when allocation tracking is on.
+            PerfCounters perf;         ///< Performance counters of the test, when collected.
+        };
+
+        /// Reporter receives the events of a run. flush () is called once the run has ended.
+        class Reporter
+        {
+            public:
+            virtual ~Reporter () {}
+            virtual void report (const TestEvent& e) = 0;
+            virtual void flush () {}
+        };
+
+        /// Bounded multi-producer, multi-consumer lock-free queue (Vyukov). Capacity is rounded up to a power of two.
+        template <typename T>
+        class RingBuffer
+        {
+            public:
+            explicit RingBuffer (size_t capacity)
+            {
+                size_t n = 2;
+                while (n < capacity)
+                    n <<= 1;
+                mask  = n - 1;
+                slots = std::unique_ptr<Slot[]> (new Slot[n]);
+                for (size_t i = 0; i < n; ++i)
+                    slots[i].sequence.store (i, std::memory_order_relaxed);
+            }
+
+            bool try_push (T&& value)
+            {
+                size_t pos = tail.load (std::memory_order_relaxed);
+                for (;;)
+                {
+                    Slot& slot = slots[pos & mask];
+                    size_t seq = slot.sequence.load (std::memory_order_acquire);
+                    intptr_t dif = static_cast<intptr_t> (seq) - static_cast<intptr_t> (pos);
+                    if (dif == 0)
+                    {
+                        if (tail.compare_exchange_weak (pos, pos + 1, std::memory_order_relaxed))
+                        {
+                            slot.value = std::move (value);
+                            slot.sequence.store (pos + 1, std::memory_order_release);
+                            return true;
+                        }
+                    }
+                    else if (dif < 0)
+                        return false;
+                    else
+                        pos = tail.load (std::memory_order_relaxed);
+                }
+            }
+
+            bool try_pop (T& value)
+            {
+                size_t pos = head.load (std::memory_order_relaxed);
+                for (;;)
+                {
+                    Slot& slot = slots[pos & mask];
+                    size_t seq = slot.sequence.load (std::memory_order_acquire);
+                    intptr_t dif = static_cast<intptr_t> (seq) - static_cast<intptr_t> (pos + 1);
+                    if (dif == 0)
+                    {
+                        if (head.compare_exchange_weak (pos, pos + 1, std::memory_order_relaxed))
+                        {
+                            value = std::move (slot.value);
+                            slot.sequence.store (pos + mask + 1, std::memory_order_release);
+                            return true;
+                        }
+                    }
+                    else if (dif < 0)
+                        return false;
+                    else
+                        pos = head.load (std::memory_order_relaxed);
+                }
+            }
+
+            private:
+            struct Slot
+            {
+                std::atomic<size_t> sequence;
+                T value;
+            };
+
+            std::unique_ptr<Slot[]> slots;
+            size_t mask;
+            alignas (64) std::atomic<size_t> head { 0 };
+            alignas (64) std::atomic<size_t> tail { 0 };
+        };
+
+        /// AsyncReporter hands events through a RingBuffer to a background thread that forwards them
+        /// to its sinks. Sinks are flushed after each batch the writer drains, never per event.
+        /// flush () blocks until every event reported so far has been written and flushed.
+        class AsyncReporter : public Reporter
+        {
+            public:
+            explicit AsyncReporter (size_t capacity = 4096) : queue (capacity) {}
+
+            ~AsyncReporter () { close (); }
+
+            /// Adds a sink. Sinks must be added before the first event is reported.
+            AsyncReporter& add (Reporter& sink) { sinks.push_back (&sink); return *this; }
+            AsyncReporter& add (std::unique_ptr<Reporter> sink) { sinks.push_back (sink.get ()); owned.push_back (std::move (sink)); return *this; }
+
+            void report (const TestEvent& e)
+            {
+                if (!running.load (std::memory_order_acquire))
+                    start ();
+                TestEvent copy = e;
+                while (!queue.try_push (std::move (copy)))
+                    std::this_thread::yield ();
+                produced.fetch_add (1, std::memory_order_release);
+                signal ();
+            }
+
+            void flush ()
+            {
+                uint64_t target = produced.load (std::memory_order_acquire);
+                for (uint64_t c = consumed.load (std::memory_order_acquire); c < target; c = consumed.load (std::memory_order_acquire))
+                    consumed.wait (c);
+            }
+
+            /// Writes out every pending event and stops the writer thread.
+            void close ()
+            {
+                std::lock_guard<std::mutex> lock (start_mutex);
+                if (!running.load (std::memory_order_acquire))
+                    return;
+                stopping.store (true, std::memory_order_release);
+                signal ();
+                writer.join ();
+                stopping.store (false, std::memory_order_release);
+                running.store (false, std::memory_order_release);
+            }
+
+            private:
+            void start ()
+            {
+                std::lock_guard<std::mutex> lock (start_mutex);
+                if (running.load (std::memory_order_acquire))
+                    return;
+                writer = std::thread ([this]() { write (); });
+                running.store (true, std::memory_order_release);
+            }
+
+            void signal ()
+            {
+                wake.fetch_add (1, std::memory_order_release);
+                wake.notify_one ();
+            }
+
+            void write ()
+            {
+                TestEvent e;
+                for (;;)
+                {
+                    uint64_t seen = wake.load (std::memory_order_acquire);
+                    uint64_t n = 0;
+                    while (queue.try_pop (e))
+                    {
+                        for (Reporter* sink : sinks)
+                            sink->report (e);
+                        ++n;
+                    }
+                    if (n != 0)
+                    {
+                        for (Reporter* sink : sinks)
+                            sink->flush ();
+                        consumed.fetch_add (n, std::memory_order_release);
+                        consumed.notify_all ();
+                    }
+                    if (stopping.load (std::memory_order_acquire) && consumed.load () == produced.load ())
+                        return;
+                    if (n == 0)
+                        wake.wait (seen);
+                }
+            }
+
+            RingBuffer<TestEvent> queue;
+            std::vector<Reporter*> sinks;
+            std::vector<std::unique_ptr<Reporter>> owned;
+            std::thread writer;
+            std::mutex start_mutex;
+            std::atomic<bool> running { false };
+            std::atomic<bool> stopping { false };
+            std::atomic<uint64_t> produced { 0 };
+            std::atomic<uint64_t> consumed { 0 };
+            std::atomic<uint64_t> wake { 0 };
+        };
+
+        /// Base of the sinks that write text to a stream they either borrow or own.
+        class StreamReporter : public Reporter
+        {
+            public:
+            explicit StreamReporter (std::basic_ostream<C>& aos) : os (&aos) {}
+
+            explicit StreamReporter (const std::filesystem::path& file) :
+                owned (std::make_unique<std::basic_ofstream<C>> (file, std::ios::binary | std::ios::trunc)),
+                os (owned.get ()) {}
+
+            void flush () { os->flush (); }
+
+            protected:
+            std::unique_ptr<std::basic_ostream<C>> owned;
+            std::basic_ostream<C>* os;
+        };
+
+        /// The runner's original console format.
+        class ConsoleReporter : public StreamReporter
+        {
+            public:
+            explicit ConsoleReporter (std::basic_ostream<C>& aos = out ()) : StreamReporter (aos) {}
+
+            void report (const TestEvent& e)
+            {
+                switch (e.kind)
+                {
+                    case TestEvent::RUN_START:
+                    case TestEvent::ITERATION:
+                        if (!e.reason.empty ())
+                            *os << e.name << W(": ") << e.reason << W('\n');
+                        break;
+                    case TestEvent::TEST_PASS:
+                    case TestEvent::TEST_FAIL:
+                        *os << e.output << pd::pad_left0 (e.number) << W(" ") << pd::pad_copy (e.name, W(' '), 25) << W(" ") << e.elapsed;
+                        if (e.memory.tracked)
+                            *os << W("\t") << e.memory.allocations << W(" allocs\t") << e.memory.bytes << W(" B\tpeak ")
+                                << e.memory.peak_bytes << W(" B\trss ") << std::showpos << e.memory.rss_delta << std::noshowpos << W(" B");
+                        if (e.perf.collected ())
+                            *os << W("\t") << e.perf;
+                        *os << W('\n');
+                        break;
+                    case TestEvent::TEST_SKIP:
+                        *os << e.output << pd::pad_left0 (e.number) << W(" ") << e.name << W(" ") << e.reason << W('\n');
+                        break;
+                    case TestEvent::RUN_END:
+                        if (e.ok)
+                            *os << W("ok") << W(" ") << e.elapsed << W('\n');
+                        break;
+                    case TestEvent::FIXTURE:
+                        *os << W("fixture ") << pd::pad_copy (e.name, W(' '), 25) << W(" set up in ") << e.nanoseconds << W(" ns");
+                        if (e.count > 1)
+                            *os << W(" (") << e.count << W(" times)");
+                        *os << W('\n');
+                        break;
+                    default:
+                        break;
+                }
+            }
+        };
+
+        /// Test Anything Protocol, version 13. The plan comes last, so the test points of every
+        /// iteration, and of a run stopped early, form one valid stream.
+        class TapReporter : public StreamReporter
+        {
+            public:
+            using StreamReporter::StreamReporter;
+
+            void report (const TestEvent& e)
+            {
+                switch (e.kind)
+                {
+                    case TestEvent::RUN_START:
+                        sequence = 0;
+                        *os << W("TAP version 13\n");
+                        break;
+                    case TestEvent::ITERATION:
+                        *os << W("# ") << e.reason << W('\n');
+                        break;
+                    case TestEvent::RUN_END:
+                        *os << W("1..") << sequence << W('\n');
+                        break;
+                    case TestEvent::TEST_PASS:
+                        *os << W("ok ") << ++sequence << W(" - ") << e.name << W('\n');
+                        diagnostics (e.output);
+                        break;
+                    case TestEvent::TEST_FAIL:
+                        *os << W("not ok ") << ++sequence << W(" - ") << e.name << W('\n');
+                        diagnostics (e.output);
+                        break;
+                    case TestEvent::TEST_SKIP:
+                        *os << W("ok ") << ++sequence << W(" - ") << e.name << W(" # SKIP ") << e.reason << W('\n');
+                        break;
+                    case TestEvent::FIXTURE:
+                        *os << W("# fixture ") << e.name << W(" set up ") << e.count << W(" time(s) in ") << e.nanoseconds << W(" ns\n");
+                        break;
+                    default:
+                        break;
+                }
+            }
+
+            private:
+            void diagnostics (const S& text)
+            {
+                size_t from = 0;
+                while (from < text.size ())
+                {
+                    size_t to = text.find (W('\n'), from);
+                    if (to == S::npos)
+                        to = text.size ();
+                    *os << W("# ") << text.substr (from, to - from) << W('\n');
+                    from = to + 1;
+                }
+            }
+
+            size_t sequence = 0;
+        };
+
+        /// One JSON object per event and line.
+        class JsonLinesReporter : public StreamReporter
+        {
+            public:
+            using StreamReporter::StreamReporter;
+
+            void report (const TestEvent& e)
+            {
+                static const C* kinds[] = { W("run_start"), W("test_start"), W("pass"), W("fail"), W("skip"), W("run_end"), W("fixture"), W("iteration") };
+                *os << W("{\"event\":\"") << kinds[e.kind] << W("\",\"name\":");
+                string (e.name);
+                switch (e.kind)
+                {
+                    case TestEvent::RUN_START:
+                        *os << W(",\"count\":") << e.count << W(",\"note\":");
+                        string (e.reason);
+                        break;
+                    case TestEvent::RUN_END:
+                        *os << W(",\"ok\":") << (e.ok ? W("true") : W("false")) << W(",\"ns\":") << e.nanoseconds;
+                        break;
+                    case TestEvent::FIXTURE:
+                        *os << W(",\"setups\":") << e.count << W(",\"ns\":") << e.nanoseconds;
+                        break;
+                    case TestEvent::ITERATION:
+                        *os << W(",\"number\":") << e.number << W(",\"count\":") << e.count << W(",\"note\":");
+                        string (e.reason);
+                        break;
+                    case TestEvent::TEST_SKIP:
+                        *os << W(",\"number\":") << e.number << W(",\"reason\":");
+                        string (e.reason);
+                        break;
+                    case TestEvent::TEST_PASS:
+                    case TestEvent::TEST_FAIL:
+                        *os << W(",\"number\":") << e.number << W(",\"ns\":") << e.nanoseconds;
+                        if (e.memory.tracked)
+                            *os << W(",\"allocs\":") << e.memory.allocations << W(",\"bytes\":") << e.memory.bytes
+                                << W(",\"peak_bytes\":") << e.memory.peak_bytes << W(",\"rss_delta\":") << e.memory.rss_delta;
+                        if (e.perf.collected ())
+                            perf (e.perf);
+                        *os << W(",\"output\":");
+                        string (e.output);
+                        break;
+                    default:
+                        *os << W(",\"number\":") << e.number;
+                        break;
+                }
+                *os << W("}\n");
+            }
+
+            private:
+            void perf (const PerfCounters& p)
+            {
+                static const C* keys[PerfCounters::EVENT_COUNT] =
+                    { W("cycles"), W("instructions"), W("l1d_misses"), W("llc_misses"), W("branch_misses"), W("task_clock_ns"), W("page_faults"), W("context_switches") };
+                *os << W(",\"perf\":{");
+                const C* separator = W("");
+                for (uint8_t e = 0; e < PerfCounters::EVENT_COUNT; ++e)
+                    if (p.has (static_cast<PerfCounters::Event> (e)))
+                    {
+                        *os << separator << W('"') << keys[e] << W("\":") << p.values[e];
+                        separator = W(",");
+                    }
+                if (p.ipc () != 0)
+                    *os << W(",\"ipc\":") << p.ipc ();
+                *os << W('}');
+            }
+
+            void string (const S& text)
+            {
+                *os << W('"');
+                for (C c : text)
+                {
+                    switch (c)
+                    {
+                        case W('"'):  *os << W("\\\""); break;
+                        case W('\\'): *os << W("\\\\"); break;
+                        case W('\n'): *os << W("\\n");  break;
+                        case W('\r'): *os << W("\\r");  break;
+                        case W('\t'): *os << W("\\t");  break;
+                        default:
+                            if (static_cast<unsigned> (c) < 0x20)
+                            {
+                                C fill = os->fill (W('0'));
+                                *os << W("\\u") << std::hex << std::setw (4) << static_cast<unsigned> (c) << std::dec;
+                                os->fill (fill);
+                            }
+                            else
+                                *os << c;
+                    }
+                }
+                *os << W('"');
+            }
+        };
+
+        /// JUnit XML. Test cases are kept until RUN_END, when the whole document is written. A repeated
+        /// run is written as one <testsuites> document with a <testsuite> per iteration.
+        class JUnitReporter : public StreamReporter
+        {
+            public:
+            using StreamReporter::StreamReporter;
+
+            void report (const TestEvent& e)
+            {
+                switch (e.kind)
+                {
+                    case TestEvent::RUN_START:
+                        suite = e.name;
+                        suites.assign (1, Suite { e.name, {} });
+                        break;
+                    case TestEvent::ITERATION:
+                        if (!suites.back ().cases.empty ())
+                            suites.emplace_back ();
+                        suites.back ().name = suite + W(" (") + e.reason + W(")");
+                        break;
+                    case TestEvent::TEST_PASS:
+                    case TestEvent::TEST_FAIL:
+                    case TestEvent::TEST_SKIP:
+                        suites.back ().cases.push_back (e);
+                        break;
+                    case TestEvent::RUN_END:
+                        write (e);
+                        break;
+                    default:
+                        break;
+                }
+            }
+
+            private:
+            struct Suite
+            {
+                S name;
+                std::vector<TestEvent> cases;
+            };
+
+            void write (const TestEvent& end)
+            {
+                *os << W("<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n");
+                if (suites.size () == 1)
+                {
+                    write (suites.front (), end.nanoseconds, W(""));
+                    return;
+                }
+                size_t tests = 0;
+                size_t failures = 0;
+                size_t skipped = 0;
+                for (const Suite& s : suites)
+                    for (const TestEvent& c : s.cases)
+                    {
+                        ++tests;
+                        failures += c.kind == TestEvent::TEST_FAIL;
+                        skipped  += c.kind == TestEvent::TEST_SKIP;
+                    }
+                *os << W("<testsuites name=\"");
+                escape (suite);
+                *os << W("\" tests=\"") << tests << W("\" failures=\"") << failures << W("\" skipped=\"") << skipped
+                    << W("\" time=\"") << seconds (end.nanoseconds) << W("\">\n");
+                for (const Suite& s : suites)
+                {
+                    int64_t ns = 0;
+                    for (const TestEvent& c : s.cases)
+                        ns += c.nanoseconds;
+                    write (s, ns, W("  "));
+                }
+                *os << W("</testsuites>\n");
+            }
+
+            void write (const Suite& s, int64_t nanoseconds, const C* indent)
+            {
+                size_t failures = 0;
+                size_t skipped = 0;
+                for (const TestEvent& c : s.cases)
+                {
+                    failures += c.kind == TestEvent::TEST_FAIL;
+                    skipped  += c.kind == TestEvent::TEST_SKIP;
+                }
+                *os << indent << W("<testsuite name=\"");
+                escape (s.name);
+                *os << W("\" tests=\"") << s.cases.size () << W("\" failures=\"") << failures << W("\" skipped=\"") << skipped
+                    << W("\" time=\"") << seconds (nanoseconds) << W("\">\n");
+                for (const TestEvent& c : s.cases)
+                {
+                    *os << indent << W("  <testcase name=\"");
+                    escape (c.name);
+                    *os << W("\" time=\"") << seconds (c.nanoseconds) << W("\"");
+                    if (c.kind == TestEvent::TEST_PASS)
+                        *os << W("/>\n");
+                    else if (c.kind == TestEvent::TEST_SKIP)
+                    {
+                        *os << W("><skipped message=\"");
+                        escape (c.reason);
+                        *os << W("\"/></testcase>\n");
+                    }
+                    else
+                    {
+                        *os << W("><failure message=\"");
+                        escape (c.name);
+                        *os << W(" failed\">");
+                        escape (c.output);
+                        *os << W("</failure></testcase>\n");
+                    }
+                }
+                *os << indent << W("</testsuite>\n");
+            }
+
+            static S seconds (int64_t ns)
+            {
+                SStream ss;
+                ss << std::fixed << std::setprecision (6) << ns / 1e9;
+                return ss.str ();
+            }
+
+            /// Control characters other than tab, line feed and carriage return are not allowed in XML 1.0,
+            /// so they are written as '?'.
+            void escape (const S& text)
+            {
+                for (C c : text)
+                {
+                    switch (c)
+                    {
+                        case W('&'):  *os << W("&amp;");  break;
+                        case W('<'):  *os << W("&lt;");   break;
+                        case W('>'):  *os << W("&gt;");   break;
+                        case W('"'):  *os << W("&quot;"); break;
+                        case W('\t'):
+                        case W('\n'):
+                        case W('\r'): *os << c;          break;
+                        default:      *os << (static_cast<unsigned> (c) < 0x20 ? W('?') : c);
+                    }
+                }
+            }
+
+            S suite;
+            std::vector<Suite> suites = std::vector<Suite> (1);
+        };
+
+        /// Set in a forked ShardedRunner worker, whose copy of the default reporter has no writer thread.
+        inline Reporter* worker_reporter = nullptr;
+
+        /// Reporter used by a CompositeTest that has none set: the console format, written asynchronously,
+        /// or worker_reporter when one is set.
+        inline Reporter& default_reporter ()
+        {
+            if (worker_reporter != nullptr)
+                return *worker_reporter;
+            struct Default : AsyncReporter
+            {
+                ConsoleReporter console;
+                Default () { add (console); }
+                ~Default () { close (); }
+            };
+            static Default reporter;
+            return reporter;
+        }
+    }  // namespace unit_test
+}  // namespace pensar_digital
+
+#endif // REPORTER_HPP
@@ -0,0 +1,349 @@
+#ifndef SHARD_HPP
+#define SHARD_HPP
+
+#include "test.hpp"
+
+#ifdef __linux__
+
+#include <cerrno>
+#include <csignal>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include <poll.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+namespace pensar_digital
+{
+    namespace unit_test
+    {
+        /// ShardedRunner runs a CompositeTest in forked worker processes, so a test that crashes or
+        /// corrupts its heap only takes down its own worker. Shard k runs every k-th test with no
+        /// ordering constraint; shard 0 also runs the ordered tests, in order, after its slice.
+        /// Workers stream one binary record per test back to the parent over a pipe. When a worker
+        /// dies mid-slice, the test it was running is reported as crashed and a new worker is forked
+        /// for the rest of the slice.
+        class ShardedRunner
+        {
+            public:
+            typedef Test T;
+
+            /// \param suite The tests to run.
+            /// \param shard_count Number of worker processes. 0 means one per hardware thread.
+            ShardedRunner (CompositeTest& suite, size_t shard_count = 0) :
+                suite (suite),
+                shards (shard_count == 0 ? WorkStealingPool::default_worker_count () : shard_count) {}
+
+            /// Runs the suite get_repeat () times, like CompositeTest::run: the tests with no ordering
+            /// constraint are shuffled when get_shuffle (), and an ITERATION event precedes each
+            /// iteration when there are several. Each iteration forks its own workers.
+            bool run ()
+            {
+                std::vector<T*> concurrent;
+                std::vector<T*> sequential;
+                suite.partition (concurrent, sequential);
+                const size_t   repeat  = suite.get_repeat ();
+                const bool     shuffle = suite.get_shuffle ();
+                const uint64_t seed    = suite.get_seed ();
+                stop = suite.get_stop_on_failure ();
+
+                Reporter& reporter = suite.get_reporter ();
+                const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now ();
+                StopWatch<> sw;
+                SStream shuffled;
+                if (shuffle && repeat == 1)
+                    shuffled << W("shuffled with seed ") << seed;
+                const size_t count = concurrent.size () + sequential.size ();
+                report_run_start (reporter, suite.get_name (), count, shuffled.str ());
+                bool ok = true;
+                for (size_t i = 0; i < repeat && (ok || !stop); ++i)
+                {
+                    std::vector<T*> order (concurrent);
+                    if (shuffle)
+                    {
+                        std::mt19937_64 rng (seed + i);
+                        std::shuffle (order.begin (), order.end (), rng);
+                    }
+                    if (repeat > 1)
+                    {
+                        SStream note;
+                        note << W("iteration ") << i + 1 << W(" of ") << repeat;
+                        if (shuffle)
+                            note << W(", shuffled with seed ") << seed + i;
+                        report_iteration (reporter, suite.get_name (), i + 1, repeat, note.str ());
+                    }
+                    bool iteration_ok = run_iteration (reporter, order, sequential);
+                    ok = ok && iteration_ok;
+                }
+                sw.stop ();
+                int64_t ns = std::chrono::duration_cast<std::chrono::nanoseconds> (std::chrono::steady_clock::now () - start).count ();
+                report_run_end (reporter, suite.get_name (), count, ok, sw.elapsed_formatted (), ns);
+                return ok;
+            }
+
+            private:
+            /// Forks the workers for one pass over concurrent, then sequential, and reports the results in that order.
+            bool run_iteration (Reporter& reporter, const std::vector<T*>& concurrent, const std::vector<T*>& sequential)
+            {
+                tests = concurrent;
+                tests.insert (tests.end (), sequential.begin (), sequential.end ());
+                results = std::vector<TestResult> (tests.size ());
+                cancelled = false;
+
+                size_t n = shards < concurrent.size () ? shards : concurrent.size ();
+                if (n == 0)
+                    n = 1;
+                std::vector<Shard> workers (n);
+                for (size_t i = 0; i < concurrent.size (); ++i)
+                    workers[i % n].slice.push_back (i);
+                for (size_t i = concurrent.size (); i < tests.size (); ++i)
+                    workers[0].slice.push_back (i);
+
+                reporter.flush ();
+                out ().flush ();
+                for (Shard& w : workers)
+                    if (!w.slice.empty ())
+                        spawn (w);
+                collect (workers);
+
+                bool ok = true;
+                for (size_t i = 0; i < tests.size (); ++i)
+                {
+                    report_start (reporter, *tests[i], tests.size () - 1 - i);
+                    report_result (reporter, *tests[i], results[i], tests.size () - 1 - i);
+                    ok = ok && results[i].ok;
+                }
+                return ok;
+            }
+
+            /// Fixed-size header of the record a worker writes for each test. It is followed by
+            /// elapsed_size characters of formatted elapsed time and output_size characters of output.
+            struct Record
+            {
+                uint32_t index;
+                uint8_t  ok;
+                uint8_t  tracked;
+                uint8_t  reserved[2];
+                uint32_t elapsed_size;
+                uint32_t output_size;
+                int64_t  nanoseconds;
+                uint64_t allocations;
+                uint64_t bytes;
+                int64_t  peak_bytes;
+                int64_t  rss_delta;
+                uint32_t perf_available;
+                uint32_t reserved2;
+                uint64_t perf[PerfCounters::EVENT_COUNT];
+            };
+            static_assert (sizeof (Record) == 64 + 8 * PerfCounters::EVENT_COUNT, "Record layout must not depend on padding.");
+
+            struct Shard
+            {
+                std::vector<size_t> slice;
+                size_t              next = 0;
+                pid_t               pid  = -1;
+                int                 fd   = -1;
+                std::string         buffer;
+            };
+
+            void spawn (Shard& w)
+            {
+                int fds[2];
+                if (pipe (fds) != 0)
+                    throw std::runtime_error (std::string ("pipe failed: ") + std::strerror (errno));
+                pid_t pid = fork ();
+                if (pid < 0)
+                    throw std::runtime_error (std::string ("fork failed: ") + std::strerror (errno));
+                if (pid == 0)
+                {
+                    close (fds[0]);
+                    work (w, fds[1]);
+                }
+                close (fds[1]);
+                w.pid = pid;
+                w.fd  = fds[0];
+            }
+
+            /// Worker process body. Runs the rest of the slice and exits without returning.
+            /// Fixtures are set up in the worker and torn down when its slice is done; their
+            /// set-up time is not reported. The default reporter's writer thread is not forked, so
+            /// a suite run by a test reports synchronously to the console instead.
+            [[noreturn]] void work (const Shard& w, int fd)
+            {
+                static ConsoleReporter console;
+                worker_reporter = &console;
+                std::vector<T*> mine;
+                for (size_t j = w.next; j < w.slice.size (); ++j)
+                    mine.push_back (tests[w.slice[j]]);
+                suite.open_fixtures (mine);
+                for (size_t j = w.next; j < w.slice.size (); ++j)
+                {
+                    size_t i = w.slice[j];
+                    TestResult r;
+                    suite.run_test (*tests[i], stop, r);
+                    if (!send (fd, i, r) || (!r.ok && stop))
+                        break;
+                }
+                suite.close_fixtures (mine, nullptr);
+                close (fd);
+                _exit (0);
+            }
+
+            static bool send (int fd, size_t index, const TestResult& r)
+            {
+                S output = r.output.str ();
+                Record h = {};
+                h.index        = static_cast<uint32_t> (index);
+                h.ok           = r.ok ? 1 : 0;
+                h.elapsed_size = static_cast<uint32_t> (r.elapsed.size ());
+                h.output_size  = static_cast<uint32_t> (output.size ());
+                h.nanoseconds  = r.nanoseconds;
+                h.tracked      = r.memory.tracked ? 1 : 0;
+                h.allocations  = r.memory.allocations;
+                h.bytes        = r.memory.bytes;
+                h.peak_bytes   = r.memory.peak_bytes;
+                h.rss_delta    = r.memory.rss_delta;
+                h.perf_available = r.perf.available;
+                std::memcpy (h.perf, r.perf.values, sizeof (h.perf));
+                std::string bytes (reinterpret_cast<const char*> (&h), sizeof (h));
+                bytes.append (reinterpret_cast<const char*> (r.elapsed.data ()), r.elapsed.size () * sizeof (C));
+                bytes.append (reinterpret_cast<const char*> (output.data ()), output.size () * sizeof (C));
+                for (size_t done = 0; done < bytes.size (); )
+                {
+                    ssize_t n = write (fd, bytes.data () + done, bytes.size () - done);
+                    if (n < 0 && errno == EINTR)
+                        continue;
+                    if (n <= 0)
+                        return false;
+                    done += static_cast<size_t> (n);
+                }
+                return true;
+            }
+
+            /// Decodes every complete record in w.buffer.
+            void receive (Shard& w)
+            {
+                size_t pos = 0;
+                while (w.buffer.size () - pos >= sizeof (Record))
+                {
+                    Record h;
+                    std::memcpy (&h, w.buffer.data () + pos, sizeof (h));
+                    size_t size = sizeof (h) + (h.elapsed_size + h.output_size) * sizeof (C);
+                    if (w.buffer.size () - pos < size)
+                        break;
+                    const C* text = reinterpret_cast<const C*> (w.buffer.data () + pos + sizeof (h));
+                    TestResult& r = results[h.index];
+                    r.done        = true;
+                    r.ran         = true;
+                    r.ok          = h.ok != 0;
+                    r.nanoseconds = h.nanoseconds;
+                    r.memory.tracked     = h.tracked != 0;
+                    r.memory.allocations = h.allocations;
+                    r.memory.bytes       = h.bytes;
+                    r.memory.peak_bytes  = h.peak_bytes;
+                    r.memory.rss_delta   = h.rss_delta;
+                    r.perf.available     = h.perf_available;
+                    std::memcpy (r.perf.values, h.perf, sizeof (h.perf));
+                    r.elapsed     = S (text, h.elapsed_size);
+                    r.output << S (text + h.elapsed_size, h.output_size);
+                    ++w.next;
+                    pos += size;
+                    if (!r.ok && stop)
+                        cancelled = true;
+                }
+                w.buffer.erase (0, pos);
+            }
+
+            /// Called when a worker's pipe is closed. Reaps it and, when it died before finishing its
+            /// slice, blames the test in flight and forks a replacement for the remainder.
+            void reap (Shard& w)
+            {
+                close (w.fd);
+                w.fd = -1;
+                int status = 0;
+                while (waitpid (w.pid, &status, 0) < 0 && errno == EINTR) {}
+                w.pid = -1;
+                if (cancelled || w.next >= w.slice.size ())
+                    return;
+
+                TestResult& r = results[w.slice[w.next]];
+                r.done = true;
+                r.ran  = true;
+                r.ok   = false;
+                r.output << tests[w.slice[w.next]]->get_name () << W(" crashed: worker process ");
+                if (WIFSIGNALED (status))
+                    r.output << W("killed by signal ") << WTERMSIG (status) << W(" (") << strsignal (WTERMSIG (status)) << W(")");
+                else
+                    r.output << W("exited with status ") << WEXITSTATUS (status);
+                r.output << std::endl;
+                ++w.next;
+                if (stop)
+                    cancelled = true;
+                else if (w.next < w.slice.size ())
+                    spawn (w);
+            }
+
+            void collect (std::vector<Shard>& workers)
+            {
+                char chunk[65536];
+                for (;;)
+                {
+                    std::vector<pollfd> fds;
+                    std::vector<Shard*> owners;
+                    for (Shard& w : workers)
+                        if (w.fd >= 0)
+                        {
+                            fds.push_back ({ w.fd, POLLIN, 0 });
+                            owners.push_back (&w);
+                        }
+                    if (fds.empty ())
+                        return;
+                    if (cancelled)
+                        for (Shard* w : owners)
+                            kill (w->pid, SIGTERM);
+                    if (poll (fds.data (), fds.size (), -1) < 0)
+                    {
+                        if (errno == EINTR)
+                            continue;
+                        throw std::runtime_error (std::string ("poll failed: ") + std::strerror (errno));
+                    }
+                    for (size_t k = 0; k < fds.size (); ++k)
+                    {
+                        if (fds[k].revents == 0)
+                            continue;
+                        ssize_t n = read (fds[k].fd, chunk, sizeof (chunk));
+                        if (n < 0 && errno == EINTR)
+                            continue;
+                        if (n > 0)
+                        {
+                            owners[k]->buffer.append (chunk, static_cast<size_t> (n));
+                            receive (*owners[k]);
+                        }
+                        else
+                            reap (*owners[k]);
+                    }
+                }
+            }
+
+            CompositeTest& suite;
+            size_t shards;
+            bool stop = true;
+            bool cancelled = false;
+            std::vector<T*> tests;
+            std::vector<TestResult> results;
+        };
+
+        /// Runs suite in shard_count forked worker processes. See ShardedRunner.
+        inline bool run_sharded (CompositeTest& suite, size_t shard_count = 0)
+        {
+            return ShardedRunner (suite, shard_count).run ();
+        }
+    }  // namespace unit_test
+}  // namespace pensar_digital
+
+#endif // __linux__
+
+#endif // SHARD_HPP
@@ -0,0 +1,216 @@
+#ifndef STRESS_HPP
+#define STRESS_HPP
+
+#include "test_fwd.hpp"
+
+#include <atomic>
+#include <barrier>
+#include <chrono>
+#include <cstdint>
+#include <exception>
+#include <iomanip>
+#include <mutex>
+#include <random>
+#include <thread>
+#include <vector>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+    #include <emmintrin.h>
+    #define UNIT_TEST_SPIN_PAUSE() _mm_pause ()
+#else
+    #define UNIT_TEST_SPIN_PAUSE() std::atomic_signal_fence (std::memory_order_seq_cst)
+#endif
+
+namespace pensar_digital
+{
+    namespace unit_test
+    {
+        /// Seed every StressTest uses instead of a random one when not 0. Set by --stress-seed S to
+        /// replay a failed run.
+        inline std::atomic<uint64_t> stress_seed_override = 0;
+
+        inline void set_stress_seed (uint64_t seed) { stress_seed_override.store (seed, std::memory_order_relaxed); }
+
+        /// What a STRESS_TEST body sees: its thread, the iteration it is running and a random number
+        /// generator seeded from the run's seed and the thread, so a thread's random choices are the
+        /// same whenever the seed is.
+        class StressContext
+        {
+            public:
+            StressContext (size_t athread, uint64_t aseed, double aperturbation) :
+                thread (athread), seed (aseed), rng (aseed), perturbation (aperturbation) {}
+
+            const size_t thread;
+            const uint64_t seed;
+            uint64_t iteration = 0;
+            std::mt19937_64 rng;
+
+            /// Uniform in [0, n).
+            uint64_t random (uint64_t n) { return n == 0 ? 0 : rng () % n; }
+
+            /// Injection point: with the test's perturbation probability, yields the CPU or spins for a
+            /// random short while, to shake out interleavings a tight loop never produces.
+            void yield_point ()
+            {
+                if (perturbation <= 0 || static_cast<double> (rng () >> 11) * 0x1.0p-53 >= perturbation)
+                    return;
+                if (rng () & 1)
+                    std::this_thread::yield ();
+                else
+                    for (uint64_t i = 0, n = random (1024); i < n; ++i)
+                        spin_pause ();
+            }
+
+            private:
+            static void spin_pause () { UNIT_TEST_SPIN_PAUSE (); }
+
+            double perturbation;
+        };
+
+        /// StressTest runs iterate () iterations times on each of threads threads, all released at
+        /// once by a barrier. Checks may be called from the workers: each thread's output is kept
+        /// apart and appended to the test's output in thread order, and during the run every failed
+        /// check throws, so the first failure stops all threads. The run then reports the thread,
+        /// iteration and seed; --stress-seed replays the threads' random choices, which with
+        /// yield_point () perturbation makes a race much likelier to recur. Throughput per thread is
+        /// reported after each run.
+        class StressTest : public Test
+        {
+            public:
+            inline static double DEFAULT_PERTURBATION = 0;
+
+            StressTest (const S& name, size_t athreads, uint64_t aiterations, const std::source_location& where = std::source_location::current ()) :
+                Test (name, NULL_ID, UNORDERED, true, true, where), threads (athreads == 0 ? 1 : athreads), iterations (aiterations) {}
+
+            /// One iteration, run by thread stress.thread.
+            virtual void iterate (StressContext& stress) = 0;
+
+            StressTest& set_threads      (size_t n  ) { threads      = n == 0 ? 1 : n; return *this; }
+            StressTest& set_iterations   (uint64_t n) { iterations   = n; return *this; }
+            /// Seed of the next runs; 0 draws a new one per run unless --stress-seed is given.
+            StressTest& set_seed         (uint64_t s) { seed         = s; return *this; }
+            /// Probability that yield_point () yields or spins.
+            StressTest& set_perturbation (double p  ) { perturbation = p; return *this; }
+
+            size_t   get_threads    () const { return threads;    }
+            uint64_t get_iterations () const { return iterations; }
+            /// Seed of the last run.
+            uint64_t get_last_seed  () const { return last_seed;  }
+
+            bool run ()
+            {
+                uint64_t run_seed = seed != 0 ? seed : stress_seed_override.load (std::memory_order_relaxed);
+                while (run_seed == 0)
+                    run_seed = (uint64_t (std::random_device () ()) << 32) | std::random_device () ();
+                last_seed = run_seed;
+
+                const bool stop = get_stop_on_failure ();
+                set_stop_on_failure (true);
+                std::vector<SStream>  outputs (threads);
+                std::vector<uint64_t> completed (threads);
+                std::vector<int64_t>  nanoseconds (threads);
+                std::atomic<bool> failed (false);
+                std::mutex failure_mutex;
+                std::exception_ptr failure;
+                size_t failed_thread = 0;
+                uint64_t failed_iteration = 0;
+                std::barrier start (static_cast<std::ptrdiff_t> (threads));
+
+                auto worker = [&](size_t t)
+                {
+                    test_stream = &outputs[t];
+                    StressContext stress (t, thread_seed (run_seed, t), perturbation);
+                    start.arrive_and_wait ();
+                    const std::chrono::steady_clock::time_point t0 = std::chrono::steady_clock::now ();
+                    try
+                    {
+                        for (; stress.iteration < iterations && !failed.load (std::memory_order_relaxed); ++stress.iteration)
+                            iterate (stress);
+                    }
+                    catch (...)
+                    {
+                        std::lock_guard<std::mutex> lock (failure_mutex);
+                        if (!failed.exchange (true))
+                        {
+                            failure = std::current_exception ();
+                            failed_thread = t;
+                            failed_iteration = stress.iteration;
+                        }
+                    }
+                    nanoseconds[t] = std::chrono::duration_cast<std::chrono::nanoseconds> (std::chrono::steady_clock::now () - t0).count ();
+                    completed[t] = stress.iteration;
+                    test_stream = nullptr;
+                };
+                std::vector<std::thread> workers;
+                workers.reserve (threads);
+                for (size_t t = 0; t < threads; ++t)
+                    workers.emplace_back (worker, t);
+                for (std::thread& w : workers)
+                    w.join ();
+                set_stop_on_failure (stop);
+
+                std::basic_ostream<C>& os = test_out ();
+                for (const SStream& o : outputs)
+                    os << o.str ();
+                os << get_name () << W("\t") << threads << W(" threads x ") << iterations << W(" iterations\tseed ") << run_seed;
+                const std::ios_base::fmtflags flags = os.flags ();
+                const std::streamsize precision = os.precision ();
+                for (size_t t = 0; t < threads; ++t)
+                    os << W("\tthread ") << t << W(" ") << std::fixed << std::setprecision (0)
+                       << (nanoseconds[t] > 0 ? completed[t] * 1e9 / nanoseconds[t] : 0.0) << W(" it/s");
+                os.flags (flags);
+                os.precision (precision);
+                os << std::endl;
+                if (!failed)
+                    return true;
+                os << get_name () << W(" failed in thread ") << failed_thread << W(" at iteration ") << failed_iteration
+                   << W("; replay with --stress-seed ") << run_seed << std::endl;
+                try
+                {
+                    std::rethrow_exception (failure);
+                }
+                catch (const Failure&)
+                {
+                    if (stop)
+                        throw;
+                }
+                return false;
+            }
+
+            private:
+            /// splitmix64 of the run's seed and the thread, so neighbouring threads get unrelated streams.
+            static uint64_t thread_seed (uint64_t run_seed, size_t thread)
+            {
+                uint64_t z = run_seed + (thread + 1) * 0x9E3779B97F4A7C15ull;
+                z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+                z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+                return z ^ (z >> 31);
+            }
+
+            size_t   threads;
+            uint64_t iterations;
+            uint64_t seed = 0;
+            uint64_t last_seed = 0;
+            double   perturbation = DEFAULT_PERTURBATION;
+        };
+
+        /// STRESS_TEST(name, threads, iterations) { body } STRESS_TEST_END(name) declares a StressTest whose
+        /// body is one iteration. It can use stress.thread, stress.iteration, stress.random (n),
+        /// stress.yield_point () and the CHECK macros.
+        #define STRESS_TEST(name, threads, iterations) \
+                      class Test##name : public StressTest         \
+                      {                                            \
+                        public:                                    \
+                        inline static const Version VERSION = Version (1, 1, 1); \
+                        Test##name ()                              \
+                        : StressTest (W(#name), threads, iterations){enlist ();};           \
+                        void iterate (StressContext& stress)       \
+                        {
+
+        #define STRESS_TEST_END(name)                                    \
+                        }                                          \
+                      }; Test ## name test_ ## name;
+    }  // namespace unit_test
+}  // namespace pensar_digital
+
+#endif // STRESS_HPP
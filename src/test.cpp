@@ -0,0 +1,222 @@
+// author : Mauricio Gomes
+// license: MIT (https://opensource.org/licenses/MIT)
+
+// The unittest library: the runner, reporters and formatting, compiled once. Test translation units
+// include test_fwd.hpp only and the executable's main calls run_tests ().
+
+#include "pch.h"
+
+#include "golden.hpp"
+#include "history.hpp"
+#include "impact.hpp"
+#include "range_compare.hpp"
+#include "shard.hpp"
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <iomanip>
+#include <limits>
+#include <optional>
+#include <string_view>
+
+namespace pensar_digital
+{
+    namespace unit_test
+    {
+        size_t first_mismatch (const void* a, const void* b, size_t n, size_t elem_size)
+        {
+            return first_mismatch (static_cast<const unsigned char*> (a), static_cast<const unsigned char*> (b), n * elem_size) / elem_size;
+        }
+
+        size_t first_outside (const float* a, const float* b, size_t n, float delta, float relative_delta)
+        {
+            return first_mismatch (a, b, n, delta, relative_delta);
+        }
+
+        size_t first_outside (const double* a, const double* b, size_t n, double delta, double relative_delta)
+        {
+            return first_mismatch (a, b, n, delta, relative_delta);
+        }
+
+        void Test::fail (Text detail, Text error_message, const Location& where, Text suffix) const
+        {
+            test_out () << where.get_file () << W(" line \t") << where.get_line () << detail << W("\t") << error_message << std::endl;
+            if (stop_on_failure)
+                throw Failure (pd::Object::id (),
+                               get_name (),
+                               S (error_message) + S (suffix), where.get_file (), where.get_line ());
+        }
+
+        bool Test::range_mismatch (const void* actual, const void* expected, size_t n, size_t first, const RangeElement& element,
+                                   double delta, double relative_delta, Text error_message, const Location& where) const
+        {
+            size_t count = 1;
+            switch (element.kind)
+            {
+                case RangeElement::FLOAT:
+                    count += count_mismatches (static_cast<const float*> (actual), static_cast<const float*> (expected), first + 1, n,
+                                               static_cast<float> (delta), static_cast<float> (relative_delta));
+                    break;
+                case RangeElement::DOUBLE:
+                    count += count_mismatches (static_cast<const double*> (actual), static_cast<const double*> (expected), first + 1, n, delta, relative_delta);
+                    break;
+                default:
+                {
+                    const unsigned char* a = static_cast<const unsigned char*> (actual);
+                    const unsigned char* e = static_cast<const unsigned char*> (expected);
+                    for (size_t i = first + 1; i < n; ++i)
+                        count += std::memcmp (a + i * element.size, e + i * element.size, element.size) != 0;
+                }
+            }
+            std::basic_ostream<C>& os = test_out ();
+            os << where.get_file () << W(" line \t") << where.get_line () << W("\t first mismatch at index [") << first
+               << W("] of ") << n << W(", ") << count << W(" mismatched element(s)\t") << error_message << std::endl;
+            write_window (os, W("\t actual   "), actual, n, first, element);
+            write_window (os, W("\t expected "), expected, n, first, element);
+            if (stop_on_failure)
+                throw Failure (pd::Object::id (),
+                               get_name (),
+                               S (error_message) + W(" at index ") + pd::to_string<size_t, false> (first), where.get_file (), where.get_line ());
+            return false;
+        }
+
+        void Test::write_window (std::basic_ostream<C>& os, const C* label, const void* values, size_t n, size_t first, const RangeElement& element)
+        {
+            const std::ios_base::fmtflags flags = os.flags ();
+            const std::streamsize precision = os.precision ();
+            const C fill = os.fill ();
+            const unsigned char* bytes = static_cast<const unsigned char*> (values);
+            size_t from = first > WINDOW ? first - WINDOW : 0;
+            size_t to   = std::min (n, first + WINDOW + 1);
+            os << label << W("@") << from << W(":");
+            for (size_t i = from; i < to; ++i)
+            {
+                const unsigned char* v = bytes + i * element.size;
+                os << (i == first ? W(" [") : W(" "));
+                if (element.kind == RangeElement::FLOAT)
+                {
+                    float f;
+                    std::memcpy (&f, v, sizeof (f));
+                    os << std::setprecision (std::numeric_limits<float>::max_digits10) << f;
+                }
+                else if (element.kind == RangeElement::DOUBLE)
+                {
+                    double d;
+                    std::memcpy (&d, v, sizeof (d));
+                    os << std::setprecision (std::numeric_limits<double>::max_digits10) << d;
+                }
+                else if (element.size > 1 && element.write != nullptr)
+                    element.write (os, v);
+                else
+                    for (size_t b = 0; b < element.size; ++b)
+                        os << std::hex << std::setw (2) << std::setfill (W('0')) << static_cast<unsigned> (v[b]) << std::dec;
+                if (i == first)
+                    os << W("]");
+            }
+            os << std::endl;
+            os.flags (flags);
+            os.precision (precision);
+            os.fill (fill);
+        }
+
+        template <typename Char>
+        bool Test::check_golden_file (std::span<const std::byte> actual, std::basic_string_view<Char> path, Text error_message, const Location& where) const
+        {
+            const std::filesystem::path file (path);
+            std::basic_ostream<C>& os = test_out ();
+            size_t golden_size = 0;
+            size_t first = 0;
+            try
+            {
+                if (std::filesystem::exists (file))
+                {
+                    MappedFile golden (file);
+                    golden_size = golden.size ();
+                    first = first_golden_mismatch (actual, golden);
+                    if (first == actual.size () && first == golden_size) [[likely]]
+                        return true;
+                    if (!golden_update_enabled ())
+                    {
+                        const unsigned char* a = reinterpret_cast<const unsigned char*> (actual.data ());
+                        const unsigned char* g = reinterpret_cast<const unsigned char*> (golden.bytes ().data ());
+                        os << where.get_file () << W(" line \t") << where.get_line () << W("\t first difference from golden file ")
+                           << file.string<C> () << W(" at offset [") << first << W("], line ")
+                           << 1 + std::count (a, a + first, '\n') << W("; actual size ") << actual.size ()
+                           << W(", golden size ") << golden_size << W("\t") << error_message << std::endl;
+                        write_window (os, W("\t actual "), a, actual.size (), first, range_element<unsigned char> ());
+                        write_window (os, W("\t golden "), g, golden_size, first, range_element<unsigned char> ());
+                    }
+                }
+                else if (!golden_update_enabled ())
+                    os << where.get_file () << W(" line \t") << where.get_line () << W("\t golden file ") << file.string<C> ()
+                       << W(" not found; run with --update-golden to create it\t") << error_message << std::endl;
+                if (golden_update_enabled ())
+                {
+                    write_file_atomically (file, actual);
+                    os << W("updated golden file ") << file.string<C> () << std::endl;
+                    return true;
+                }
+            }
+            catch (const std::exception& e)
+            {
+                os << where.get_file () << W(" line \t") << where.get_line () << W("\t golden file ") << file.string<C> ()
+                   << W(": ") << e.what () << W("\t") << error_message << std::endl;
+            }
+            if (stop_on_failure)
+                throw Failure (pd::Object::id (),
+                               get_name (),
+                               S (error_message) + W(" at offset ") + pd::to_string<size_t, false> (first), where.get_file (), where.get_line ());
+            return false;
+        }
+
+        bool Test::check_golden (std::span<const std::byte> actual, std::string_view path, Text error_message, const Location& where) const
+        {
+            return check_golden_file (actual, path, error_message, where);
+        }
+
+        bool Test::check_golden (std::span<const std::byte> actual, std::wstring_view path, Text error_message, const Location& where) const
+        {
+            return check_golden_file (actual, path, error_message, where);
+        }
+
+        int run_tests (int argc, const char* const argv[])
+        {
+            CompositeTest& suite = all_tests ();
+            suite.parse_arguments (argc, argv);
+            try
+            {
+                select_impacted (suite, argc, argv);
+            }
+            catch (const std::exception& e)
+            {
+                out () << W("impact selection failed: ") << e.what () << std::endl;
+                return EXIT_FAILURE;
+            }
+            std::optional<RegressionGate> history;
+            try
+            {
+                history.emplace (suite, argc, argv);
+            }
+            catch (const std::exception& e)
+            {
+                out () << W("timing history: ") << e.what () << std::endl;
+                return EXIT_FAILURE;
+            }
+            bool ok = false;
+            bool sharded = false;
+            #ifdef __linux__
+                for (int i = 1; i + 1 < argc && !sharded; ++i)
+                    if (std::string_view (argv[i]) == "--shards")
+                    {
+                        ok = run_sharded (suite, std::strtoull (argv[i + 1], nullptr, 10));
+                        sharded = true;
+                    }
+            #endif
+            if (!sharded)
+                ok = suite.run ();
+            ok = history->finish () && ok;
+            return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+        }
+    }  // namespace unit_test
+}  // namespace pensar_digital
@@ -1,31 +1,41 @@
 #ifndef TEST_HPP
 #define TEST_HPP
 
-#define _WINSOCKAPI_
-#include <winsock2.h>
+#ifdef _WIN32
+    #define _WINSOCKAPI_
+    #include <winsock2.h>
+#endif
 
-#include "../../cpplib/src/constant.hpp"
-#include "../../cpplib/src/string_def.hpp"
+#include "test_fwd.hpp"
+#include "async_test.hpp"
 
-#include "../../cpplib/src/generator.hpp"
-#include "../../cpplib/src/macros.hpp"
-#include "../../cpplib//src/s.hpp"
-#include "../../cpplib/src/error.hpp"
-#include "../../cpplib/src/concept.hpp"
 #include "../../cpplib/src/stop_watch.hpp"
 #include "../../cpplib/src/path.hpp"
-#include "../../cpplib/src/stream_util.hpp"
-#include "../../cpplib/src/version.hpp"
+
+#include "fixture.hpp"
+#include "golden.hpp"
+#include "memory_probe.hpp"
+#include "property.hpp"
+#include "reporter.hpp"
+#include "stress.hpp"
+#include "thread_pool.hpp"
 
 #include <string>
 #include <stdexcept>
 #include <sstream>
 #include <unordered_map>
-#include <queue>
 #include <iostream>
-#include <concepts>
-#include <span>
-#include <cmath> // Added for std::abs
+#include <string_view>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <functional>
+#include <iomanip>
+#include <mutex>
+#include <random>
+#include <vector>
 
 namespace pensar_digital
 {
@@ -34,449 +44,565 @@ namespace pensar_digital
     {
         using namespace cpplib;
 
-        const int UNORDERED = -1;
-        class Failure : Error
+        /// Outcome of one test run by CompositeTest, kept until its turn to be printed comes.
+        struct TestResult
         {
-            public:
-                //inline static const pd::Version::Ptr VERSION = pd::Version::get (1, 1, 1);
-            using Error::get_error_message;
-            Failure (const Id id,
-                     const std::basic_string<C>&     name,
-                     const std::basic_string<C>&     err_msg,
-                     const std::basic_string<C>&     afile,
-                     const unsigned    aline):
-                Error(err_msg, id),
-                test_id (id),
-                test_name (name),
-                file (afile),
-                line (aline)
-            {
-				SStream ss;
-				ss << file << W(" line \t") << line << W("\ttest_id = ") << id << W("\ttest_name = ") << name << W("\terror = ") << err_msg;
-				Error::set_error_message (ss.str ());
-            };
-
-            private:
-            const Id test_id;
-            const S& test_name;
-            const S& file;
-            const unsigned line;
+            bool    done = false;
+            bool    ran  = false;
+            bool    ok   = true;
+            int64_t nanoseconds = 0;
+            S       elapsed;
+            SStream output;
+            MemoryUsage memory;
+            PerfCounters perf;
         };
 
-        /// Test is the interface to be implemented by all test classes..
-        class Test : public Object
+        /// Runs t with its output captured in r.output, then restores the thread's previous test
+        /// stream, so a suite run from inside a test leaves the outer test's capture in place. Never throws.
+        inline void run_captured (Test& t, bool stop_on_failure, TestResult& r)
         {
-            private:
-                /// ID generator for tests.
-                static Generator<Test> generator;
-                int order;
-                bool stop_on_failure;
-                bool enabled;
-                S name;
-            public:
-                static constexpr double DEFAULT_DELTA = 0.0000001; // Added default delta
-                //inline static const Version::Ptr VERSION = pd::Version::get (1, 1, 1);
-                typedef Test T;
-
-            /// Constructor.
-            /// \param test_name The test name.
-            /// \param aid The test ID. One will be provided by default if you do not pass one.
-                Test(const   S& test_name,
-                     const   Id       aid          =   NULL_ID,
-                            int       aorder       = UNORDERED,
-                           bool       stop_on_fail =      true,
-                           bool       is_enabled   = true) :
-                name            (test_name   ),
-                order           (aorder      ),
-                stop_on_failure (stop_on_fail),
-                enabled         (is_enabled  ) {}
-
-            /// Virtual destructor.
-            virtual ~Test() {}
-
-            /// Tests run calling this method.
-            virtual bool run () = 0;
-
-            S get_name () const { return name; }
-			
-            void set_name (const S& a_name) { name = a_name; }
-
-            // Specialization for floating-point types
-            template <std::floating_point T>
-            bool check_equal(const T& actual, const T& expected, const S& error_message, const S& file, const unsigned line, double delta = DEFAULT_DELTA) const
+            if (!t.is_enabled ())
             {
-                bool ok = std::abs(actual - expected) < delta;
-                if (!ok)
-                    error<T>(actual, expected, error_message + W(" (delta = ") + pd::to_string(delta) + W(")"), file, line);
-                return ok;
+                r.ran = true;
+                return;
             }
-
-            bool check_equal(const char* actual, const char* expected, const S& error_message, const S& file, const unsigned line) const
+            std::basic_ostream<C>* const outer_stream = test_stream;
+            test_stream = &r.output;
+            t.set_stop_on_failure (stop_on_failure);
+            // The probes are set up first so opening the counters is not timed.
+            MemoryProbe probe;
+            PerfProbe perf;
+            StopWatch<> sw;
+            sw.mark ();
+            const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now ();
+            try
             {
-                bool ok = (strcmp(actual, expected) == 0);
-                if (!ok)
-                {
-                    std::string sactual(actual);
-                    std::string sexpected(expected);
-                    error(sactual, sexpected, error_message, file, line);
-                }
-                return ok;
+                r.ok = t.run ();
             }
-            template <OutputStreamable T>
-            void error(const T& actual, const T& expected, const S& error_message, const S& file, const unsigned line) const
-			{
-                if constexpr (std::is_same_v<T, std::string>) 
-                {
-                    S sactual;
-                    S sexpected;
-                    #ifdef WIDE_CHAR
-                        sactual = to_wstring(actual);
-                        sexpected = to_wstring(expected);
-                        out() << file << W(" line \t") << line << W("\t actual [") << sactual << W("] != [") << sexpected << W("] expected\t") << error_message << std::endl;
-                    #else
-                        sactual = actual;
-                        sexpected = expected;
-                        out() << file << W(" line \t") << line << W("\t actual [") << sactual << W("] != [") << sexpected << W("] expected\t") << error_message << std::endl;
-                    #endif      
-                }
-                else
-                {
-                    out() << file << W(" line \t") << line << W("\t actual [") << actual << W("] != [") << expected << W("] expected\t") << error_message << std::endl;
-                }
-                if (stop_on_failure)
-                    throw Failure (pd::Object::id(),
-                        get_name (),
-                        error_message, file, line);
+            catch (const Failure& f)
+            {
+                r.ok = false;
+                r.output << f.get_error_message () << std::endl;
             }
-            
-            /// If expression is false and stop_on_failure = true throws an Error exception.
-            bool check(bool expression, const S& error_message, const S& file, const unsigned line) const
+            catch (const std::exception& e)
             {
-                if (!expression)
-                {
-                    error<bool>(expression, true, error_message, file, line);
-                }
-                return expression;
+                r.ok = false;
+                r.output << t.get_name () << W(" threw an unexpected exception: ") << e.what () << std::endl;
             }
-
-            /// <summary>
-            /// 
-            /// </summary>
-            /// <typeparam name="T"></typeparam>
-            /// <param name="actual"></param>
-            /// <param name="expected"></param>
-            /// <param name="error_message"></param>
-            /// <param name="file"></param>
-            /// <param name="line"></param>
-            /// <returns></returns>
-            template <OutputStreamable  T> bool check_equal(const T& actual, const T& expected, const S& error_message, const S& file, const unsigned line) const
+            catch (...)
             {
-                bool ok = (actual == expected);
-                if (! ok)
-                    error<T>(actual, expected, error_message, file, line);
-                return ok;
-            };
+                r.ok = false;
+                r.output << t.get_name () << W(" threw an unexpected exception.") << std::endl;
+            }
+            const std::chrono::steady_clock::time_point end = std::chrono::steady_clock::now ();
+            r.perf = perf.stop ();
+            r.memory = probe.stop ();
+            r.nanoseconds = std::chrono::duration_cast<std::chrono::nanoseconds> (end - start).count ();
+            r.elapsed = sw.elapsed_since_mark_formatted ();
+            r.ran = true;
+            test_stream = outer_stream;
+        }
 
+        /// Reports that t, shown as number, starts.
+        inline void report_start (Reporter& reporter, const Test& t, size_t number)
+        {
+            TestEvent e;
+            e.kind   = TestEvent::TEST_START;
+            e.number = number;
+            e.name   = t.get_name ();
+            reporter.report (e);
+        }
 
-           /* bool check_equal(const wchar_t* actual, const wchar_t* expected, const S& error_message, const S& file, const unsigned line) const
+        /// Reports the outcome of t: passed, failed, or skipped because it is disabled or was cancelled.
+        inline void report_result (Reporter& reporter, const Test& t, const TestResult& r, size_t number)
+        {
+            TestEvent e;
+            e.number      = number;
+            e.id          = t.id ();
+            e.name        = t.get_name ();
+            e.nanoseconds = r.nanoseconds;
+            e.elapsed     = r.elapsed;
+            e.output      = r.output.str ();
+            e.memory      = r.memory;
+            e.perf        = r.perf;
+            if (!r.ran)
             {
-               bool ok = (wcscmp(actual, expected) == 0);
-               if (! ok)
-               {
-				   std::wstring sactual(actual);
-				   std::wstring sexpected(expected);
-				   error<std::wstring>(sactual, sexpected, error_message, file, line);
-			   }
-               return ok;
-			}*/
-            
-            //----------------
-            template <OutputStreamable  T> bool check_not_equal(const T& actual, const T& expected, const S& error_message, const S& file, const unsigned line) const
+                e.kind   = TestEvent::TEST_SKIP;
+                e.reason = W("was cancelled.");
+            }
+            else if (!t.is_enabled ())
             {
-                bool ok = (actual != expected);
-                if (!ok)
-                    error(actual, expected, error_message, file, line);
-                return ok;
+                e.kind   = TestEvent::TEST_SKIP;
+                e.reason = W("is disabled.");
+            }
+            else
+                e.kind = r.ok ? TestEvent::TEST_PASS : TestEvent::TEST_FAIL;
+            reporter.report (e);
+        }
+
+        /// Reports the start of a suite run. note, when not empty, gives the shuffle seed.
+        inline void report_run_start (Reporter& reporter, const S& name, size_t count, const S& note = S ())
+        {
+            TestEvent e;
+            e.kind   = TestEvent::RUN_START;
+            e.name   = name;
+            e.count  = count;
+            e.reason = note;
+            reporter.report (e);
+        }
+
+        /// Reports the start of iteration number (1-based) of count, for a run repeated count times.
+        inline void report_iteration (Reporter& reporter, const S& name, size_t number, size_t count, const S& note)
+        {
+            TestEvent e;
+            e.kind   = TestEvent::ITERATION;
+            e.name   = name;
+            e.number = number;
+            e.count  = count;
+            e.reason = note;
+            reporter.report (e);
+        }
+
+        /// Reports the end of a suite run and waits until the reporter has written it out.
+        inline void report_run_end (Reporter& reporter, const S& name, size_t count, bool ok, const S& elapsed, int64_t nanoseconds)
+        {
+            TestEvent e;
+            e.kind        = TestEvent::RUN_END;
+            e.name        = name;
+            e.count       = count;
+            e.ok          = ok;
+            e.elapsed     = elapsed;
+            e.nanoseconds = nanoseconds;
+            reporter.report (e);
+            reporter.flush ();
+        }
+
+        /// Reports the set-ups of a fixture during the run that is ending.
+        inline void report_fixture (Reporter& reporter, const S& name, size_t setups, int64_t nanoseconds)
+        {
+            TestEvent e;
+            e.kind        = TestEvent::FIXTURE;
+            e.name        = name;
+            e.count       = setups;
+            e.nanoseconds = nanoseconds;
+            reporter.report (e);
+        }
+
+        /// CompositeTest aggregates several tests together.
+        /// Tests are kept in a flat registry of descriptors, sorted once (lazily, after the last add) so
+        /// that the tests with no ordering constraint come first, in registration order, followed by the
+        /// ordered ones by ascending order. Running never consumes the registry, so a suite can be run
+        /// any number of times, optionally repeated and shuffled by run () itself.
+        class CompositeTest : public Test
+        {
+            public:
+			inline static const Version::Ptr VERSION = pd::Version::get (1, 1, 1);
+            typedef Test T;
+
+            /// Registry entry.
+            struct TestDescriptor
+            {
+                T*     test;
+                int    order;
+                size_t registration;
             };
 
-            // Specialization for floating-point types
-            template <std::floating_point T>
-            bool check_not_equal(const T& actual, const T& expected, const S& error_message, const S& file, const unsigned line, double delta = DEFAULT_DELTA) const
+            CompositeTest(const S& test_name = W(""), const Id aid = NULL_ID, int aorder = UNORDERED, bool stop_on_fail = true) :
+                T(test_name, aid, aorder, stop_on_fail)
             {
-                bool ok = std::abs(actual - expected) >= delta;
-                if (!ok)
-                    error<T>(actual, expected, error_message + W(" (delta = ") + pd::to_string(delta) + W(")"), file, line);
-                return ok;
+                set_id (generator.get_id ());
             }
 
-            bool check_not_equal(const char* actual, const char* expected, const S& error_message, const S& file, const unsigned line) const
+            void add (T& test)
             {
-                bool ok = (strcmp(actual, expected) != 0);
-                if (!ok)
-                {
-                    std::string sactual(actual);
-                    std::string sexpected(expected);
-                    error<std::string>(sactual, sexpected, error_message, file, line);
-                }
-                return ok;
+                test.set_stop_on_failure (Test::get_stop_on_failure ());
+                registry.push_back ({ &test, test.get_order (), registry.size () });
+                sorted = false;
+            };
+
+            void add (T* test) { add (*test); };
+
+            /// The test registered as name, or nullptr.
+            T* find (const S& name)
+            {
+                sort ();
+                auto i = names.find (name);
+                return i == names.end () ? nullptr : registry[i->second].test;
             }
 
-            /*bool check_not_equal(const wchar_t* actual, const wchar_t* expected, const S& error_message, const S& file, const unsigned line) const
+            /// Number of threads run () uses. 1 (the default) runs every test on the calling thread.
+            /// 0 uses one thread per hardware thread.
+            CompositeTest& set_workers (size_t n) { workers = (n == 0 ? WorkStealingPool::default_worker_count () : n); return *this; }
+            size_t get_workers () const { return workers; }
+
+            /// Number of times run () runs the suite. Useful for soak and flakiness runs.
+            CompositeTest& set_repeat (size_t n) { repeat = n == 0 ? 1 : n; return *this; }
+            size_t get_repeat () const { return repeat; }
+
+            /// Shuffles the tests with no ordering constraint before each iteration. Iteration i uses
+            /// seed + i, which is reported so a failing order can be replayed with --seed.
+            CompositeTest& set_shuffle (bool on, uint64_t aseed = std::random_device () ()) { shuffle = on; seed = aseed; return *this; }
+            bool get_shuffle () const { return shuffle; }
+            uint64_t get_seed () const { return seed; }
+
+            /// Collects hardware / software performance counters around each test (Linux only).
+            CompositeTest& set_perf_counters (bool on) { enable_perf_counters (on); return *this; }
+
+            /// Predicate a test must satisfy to be run. Tests it rejects are left out of the run entirely.
+            typedef std::function<bool (const T&)> Filter;
+            CompositeTest& set_filter (Filter f) { filter = std::move (f); return *this; }
+
+            /// Reporter the run's events go to. nullptr (the default) uses default_reporter ().
+            CompositeTest& set_reporter (Reporter* r) { reporter = r; return *this; }
+            Reporter& get_reporter () const { return reporter == nullptr ? default_reporter () : *reporter; }
+
+            /// Applies the command line options the runner understands and ignores the others:
+            /// --workers N, --repeat N, --shuffle, --seed S, --perf, --update-golden, --stress-seed S,
+            /// --property-seed S, --property-cases N.
+            CompositeTest& parse_arguments (int argc, const char* const argv[])
             {
-                bool ok = (wcscmp(actual, expected) != 0);
-                if (!ok)
+                bool seeded = false;
+                uint64_t aseed = 0;
+                for (int i = 1; i < argc; ++i)
                 {
-                    std::wstring sactual(actual);
-                    std::wstring sexpected(expected);
-                    error(sactual, sexpected, error_message, file, line);
+                    std::string_view arg (argv[i]);
+                    bool has_value = i + 1 < argc;
+                    if (arg == "--workers" && has_value)
+                        set_workers (std::strtoull (argv[++i], nullptr, 10));
+                    else if (arg == "--repeat" && has_value)
+                        set_repeat (std::strtoull (argv[++i], nullptr, 10));
+                    else if (arg == "--shuffle")
+                        shuffle = true;
+                    else if (arg == "--perf")
+                        set_perf_counters (true);
+                    else if (arg == "--update-golden")
+                        enable_golden_update (true);
+                    else if (arg == "--stress-seed" && has_value)
+                        set_stress_seed (std::strtoull (argv[++i], nullptr, 10));
+                    else if (arg == "--property-seed" && has_value)
+                        PropertyBase::seed_override = std::strtoull (argv[++i], nullptr, 10);
+                    else if (arg == "--property-cases" && has_value)
+                        PropertyBase::DEFAULT_CASES = std::strtoull (argv[++i], nullptr, 10);
+                    else if (arg == "--seed" && has_value)
+                    {
+                        aseed = std::strtoull (argv[++i], nullptr, 10);
+                        seeded = true;
+                    }
                 }
-                return ok;
-            }*/
+                if (shuffle)
+                    set_shuffle (true, seeded ? aseed : std::random_device () ());
+                return *this;
+            }
 
-            template <Container A, Container E> 
-            bool check_equal_collection(const A& actual, const E& expected, const S& error_message, const S& file, const unsigned line) const
+            /// Runs the suite get_repeat () times. Each iteration runs the tests with no ordering
+            /// constraint (shuffled when get_shuffle ()), then the ordered ones by ascending order.
+            /// Each test's output is captured and handed to the reporter with its result. The
+            /// iterations form one run for the reporter: a single RUN_START / RUN_END pair, with an
+            /// ITERATION event before each iteration when there are several.
+            virtual bool run ()
             {
-                bool ok = false;
-                try
+                std::vector<T*> concurrent;
+                std::vector<T*> sequential;
+                partition (concurrent, sequential);
+                Reporter& r = get_reporter ();
+                const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now ();
+                StopWatch<> sw;
+                SStream shuffled;
+                if (shuffle && repeat == 1)
+                    shuffled << W("shuffled with seed ") << seed;
+                report_run_start (r, get_name (), concurrent.size () + sequential.size (), shuffled.str ());
+                bool ok = true;
+                for (size_t i = 0; i < repeat && (ok || !Test::get_stop_on_failure ()); ++i)
                 {
-                    ok = (actual.size() == expected.size());
-                    if (not ok)
+                    std::vector<T*> order (concurrent);
+                    if (shuffle)
                     {
-                        out () << file << W(" line \t");
-                        out () << line << W("\t actual size [") << actual.size();
-                        out () << W("] != [") << expected.size() << W("] expected size\t") << error_message << std::endl;
-                        if (stop_on_failure)
-                            throw Failure (pd::Object::id (),
-                                              get_name (),
-                                              error_message, file, line);
+                        std::mt19937_64 rng (seed + i);
+                        std::shuffle (order.begin (), order.end (), rng);
                     }
-
-                    if (ok)
+                    if (repeat > 1)
                     {
-                        for (size_t i = 0; i < actual.size(); i++)
-                        {
-                            S err = error_message + W(" at index ");
-                            err += pd::to_string<size_t, false>(i);
-                            typename E::value_type const expected_value = expected[i];
-                            typename A::value_type const actual_value = actual[i];
-                            ok = check_equal<typename A::value_type>(actual_value, expected_value, err, file, line);
-                        }
+                        SStream note;
+                        note << W("iteration ") << i + 1 << W(" of ") << repeat;
+                        if (shuffle)
+                            note << W(", shuffled with seed ") << seed + i;
+                        report_iteration (r, get_name (), i + 1, repeat, note.str ());
                     }
-                    return ok;
-                }
-                catch (const Exception& e)
-                {
-                    ok = false;
-                    if (stop_on_failure)
-                        throw Failure (pd::Object::id(), 
-                                          get_name (), 
-                                          error_message + e.what_error(), file, line);
+                    bool iteration_ok = workers > 1 ? run_parallel (order, sequential)
+                                                    : run_serial   (order, sequential);
+                    ok = ok && iteration_ok;
                 }
+                sw.stop ();
+                report_run_end (r, get_name (), concurrent.size () + sequential.size (), ok, sw.elapsed_formatted (), elapsed_since (start));
                 return ok;
-            };
-
+            }
 
-            int           get_order          () const { return order;             }
-            bool          get_stop_on_failure() const { return stop_on_failure;   }
-            bool          is_enabled         () const { return enabled;           }
-            bool          is_ordered         () const { return order == UNORDERED;}
+            size_t count () const { return registry.size (); }
 
-            Test& enable () { enabled = true ; return *this; }
-            Test& disable() { enabled = false; return *this; }
+            /// Splits the registered tests the filter accepts into those with no ordering constraint, in
+            /// registration order, and the ordered ones sorted by ascending order.
+            void partition (std::vector<T*>& concurrent, std::vector<T*>& sequential)
+            {
+                sort ();
+                concurrent.reserve (concurrent.size () + ordered_begin);
+                for (size_t i = 0; i < ordered_begin; ++i)
+                    if (!filter || filter (*registry[i].test))
+                        concurrent.push_back (registry[i].test);
+                sequential.reserve (sequential.size () + registry.size () - ordered_begin);
+                for (size_t i = ordered_begin; i < registry.size (); ++i)
+                    if (!filter || filter (*registry[i].test))
+                        sequential.push_back (registry[i].test);
+            }
 
-            Test& set_stop_on_failure ( bool Stop         ) { stop_on_failure = Stop; return *this; }
+            const std::vector<TestDescriptor>& get_registry () { sort (); return registry; }
 
-            bool operator==  (const T& t) const { return pd::Object::id () == t.id ();}
-            bool operator<   (const T& t) const { return order < t.order;       }
-            bool operator!=  (const T& t) const { return !(*this == t);          }
+            /// Runs t after setting up the fixtures it and the suite use, then releases t's fixtures.
+            /// Set-up time is not part of the test's time. A failed set-up fails the test.
+            void run_test (T& t, bool stop, TestResult& r)
+            {
+                if (set_up_fixtures (t, r))
+                    run_captured (t, stop, r);
+                release_fixtures (t);
+            }
 
-            virtual std::istream& read (std::istream& is, const std::endian& byte_order = std::endian::native)
+            /// Runs the enabled asynchronous tests among tests together on one EventLoop, so their waits
+            /// overlap, and sets batched[i] for each test run; its outcome is in results[i]. Fixtures are
+            /// set up before the loop starts and released after it ends.
+            void run_async_batch (const std::vector<T*>& tests, std::vector<TestResult>& results, std::vector<bool>& batched, bool stop)
             {
-                return is;
+                std::vector<AsyncTest*> async;
+                std::vector<TestResult*> outcomes;
+                for (size_t i = 0; i < tests.size (); ++i)
+                {
+                    AsyncTest* a = dynamic_cast<AsyncTest*> (tests[i]);
+                    if (a == nullptr || !a->is_enabled ())
+                        continue;
+                    batched[i] = true;
+                    if (!set_up_fixtures (*tests[i], results[i]))
+                        continue;
+                    async.push_back (a);
+                    outcomes.push_back (&results[i]);
+                }
+                if (!async.empty ())
+                {
+                    EventLoop loop;
+                    loop.run (async, outcomes, stop);
+                }
+                for (size_t i = 0; i < tests.size (); ++i)
+                    if (batched[i])
+                        release_fixtures (*tests[i]);
             }
 
-            virtual std::ostream& write (std::ostream& os, const std::endian& byte_order = std::endian::native) const
+            /// Announces the run of tests to the fixtures they use, so each is torn down after its last dependent.
+            void open_fixtures (const std::vector<T*>& tests)
             {
-                return os;
+                for (T* t : tests)
+                    if (t->is_enabled ())
+                        for (FixtureBase* f : t->get_fixtures ())
+                            f->expect (1);
             }
-        };
 
-        /// CompositeTest aggregates several tests together.
-        class CompositeTest : public Test
-        {
-            public:
-			inline static const Version::Ptr VERSION = pd::Version::get (1, 1, 1);
-            typedef Test T;
-            typedef std::unordered_map<Id, T*> UnorderedTestMap;
-            typedef std::priority_queue<T*> OrderedTestQueue;
+            /// Tears down the fixtures of the suite and of tests still up and, when reporter is not
+            /// nullptr, reports the set-up time of each fixture set up during the run.
+            void close_fixtures (const std::vector<T*>& tests, Reporter* reporter)
+            {
+                std::vector<FixtureBase*> used (get_fixtures ());
+                for (T* t : tests)
+                    used.insert (used.end (), t->get_fixtures ().begin (), t->get_fixtures ().end ());
+                std::sort (used.begin (), used.end ());
+                used.erase (std::unique (used.begin (), used.end ()), used.end ());
+                for (FixtureBase* f : used)
+                {
+                    f->dispose ();
+                    std::pair<size_t, int64_t> stats = f->take_setup_stats ();
+                    if (reporter != nullptr && stats.first > 0)
+                        report_fixture (*reporter, f->get_name (), stats.first, stats.second);
+                }
+            }
 
-            CompositeTest(const S& test_name = W(""), const Id aid = NULL_ID, int aorder = UNORDERED, bool stop_on_fail = true) :
-                T(test_name, aid, aorder, stop_on_fail),
-                unordered_tests(UnorderedTestMap()),
-                ordered_tests (OrderedTestQueue ())
+            private:
+            /// Sets up the fixtures of the suite and of t. A failed set-up fails t and returns false.
+            bool set_up_fixtures (T& t, TestResult& r)
             {
-                set_id (generator.get_id ());
+                if (!t.is_enabled ())
+                    return true;
+                try
+                {
+                    for (FixtureBase* f : get_fixtures ())
+                        f->ensure ();
+                    for (FixtureBase* f : t.get_fixtures ())
+                        f->ensure ();
+                }
+                catch (const std::exception& e)
+                {
+                    r.ran = true;
+                    r.ok  = false;
+                    r.output << t.get_name () << W(": ") << e.what () << std::endl;
+                    return false;
+                }
+                return true;
             }
 
-            void add (T& test)
+            void release_fixtures (T& t)
             {
-                test.set_stop_on_failure (Test::get_stop_on_failure ());
-                if (test.is_ordered ())
-                    ordered_tests.push (&test);
-                else
-                    unordered_tests.insert (std::pair<Id, T*> (test.get_order (), &test));
-            };
+                if (t.is_enabled ())
+                    for (FixtureBase* f : t.get_fixtures ())
+                        f->release ();
+            }
 
-            void add (T* test) { add (*test); };
+            /// Sorts the registry and rebuilds the name index if tests were added since the last call.
+            void sort ()
+            {
+                if (sorted)
+                    return;
+                std::sort (registry.begin (), registry.end (), [](const TestDescriptor& a, const TestDescriptor& b)
+                {
+                    bool ao = a.order != UNORDERED;
+                    bool bo = b.order != UNORDERED;
+                    if (ao != bo)
+                        return bo;
+                    if (ao && a.order != b.order)
+                        return a.order < b.order;
+                    return a.registration < b.registration;
+                });
+                names.clear ();
+                names.reserve (registry.size ());
+                ordered_begin = registry.size ();
+                for (size_t i = 0; i < registry.size (); ++i)
+                {
+                    names.emplace (registry[i].test->get_name (), i);
+                    if (registry[i].order != UNORDERED && ordered_begin == registry.size ())
+                        ordered_begin = i;
+                }
+                sorted = true;
+            }
 
-            virtual bool run ()
+            bool run_serial (const std::vector<T*>& concurrent, const std::vector<T*>& sequential)
             {
-                namespace pd = pensar_digital::cpplib;
+                std::vector<T*> tests (concurrent);
+                tests.insert (tests.end (), sequential.begin (), sequential.end ());
+
+                Reporter& r = get_reporter ();
+                const bool stop = Test::get_stop_on_failure ();
+                open_fixtures (tests);
+                std::vector<TestResult> async_results (concurrent.size ());
+                std::vector<bool> batched (concurrent.size ());
+                run_async_batch (concurrent, async_results, batched, stop);
                 bool ok = true;
-                size_t count = CompositeTest::count ();
-                StopWatch<> sw;
-                try
+                for (size_t i = 0; i < tests.size (); ++i)
                 {
-                    for (UnorderedTestMap::value_type t: unordered_tests)
+                    TestResult result;
+                    if (i < batched.size () && batched[i])
                     {
-                        if (t.second->is_enabled())
-                        {
-                            t.second->set_stop_on_failure(Test::get_stop_on_failure());
-                            sw.mark ();
-                            ok = t.second->run();
-                            out () << pd::pad_left0(--count) << W(" ") << pd::pad_copy (t.second->get_name (), W(' '), 25) << W(" ") << sw.elapsed_since_mark_formatted() << std::endl;
-                        }
-                        else
-                        {
-                            ok = true;
-                            out () << pd::pad_left0 (--count) << W(" ") << t.second->get_name () << W(" is disabled.") << std::endl;
-						}
-                        if (!ok && Test::get_stop_on_failure ())
-                            break;
+                        report_start (r, *tests[i], tests.size () - 1 - i);
+                        result = std::move (async_results[i]);
                     }
-                    if (ok)
+                    else if (ok || !stop)
                     {
-                        while (! ordered_tests.empty ())
-                        {
-                            T *t = ordered_tests.top();
-                            if (t->is_enabled())
-                            {
-                                t->set_stop_on_failure(Test::get_stop_on_failure());
-                                sw.mark ();
-                                ok = t->run();
-                                out () << pd::pad_copy (pd::to_string<size_t, false>(--count), W('0'), 4, PAD_LEFT) << W(" ") << pd::pad_copy(t->get_name (), W(' '), 30) << W(" ") << sw.elapsed_since_mark_formatted() << std::endl;
-                            }
-                            else
-							{
-								ok = true;
-                                out () << --count << W(" ") << t->get_name () << W(" is disabled.") << std::endl;
-							}
-                            ordered_tests.pop ();
-                            if (!ok && Test::get_stop_on_failure ())
-                                break;
-                        }
+                        report_start (r, *tests[i], tests.size () - 1 - i);
+                        run_test (*tests[i], stop, result);
                     }
-                    sw.stop();
-                    if (ok) { out () << W("ok") << W(" ") << sw.elapsed_formatted (); }
+                    report_result (r, *tests[i], result, tests.size () - 1 - i);
+                    ok = ok && result.ok;
                 }
-                catch (const Failure& f)
+                close_fixtures (tests, &r);
+                return ok;
+            }
+
+            /// Runs the concurrent tests on a WorkStealingPool, then the sequential ones one at a time.
+            /// Output is buffered per test and reported in the sequence the serial runner uses, so lines
+            /// from concurrent tests never interleave. When stop_on_failure is set, the first failure
+            /// cancels all tests not yet started.
+            bool run_parallel (const std::vector<T*>& concurrent, const std::vector<T*>& sequential)
+            {
+                const size_t total = concurrent.size () + sequential.size ();
+                const bool stop = Test::get_stop_on_failure ();
+                std::atomic<bool> cancelled (false);
+                std::vector<TestResult> results (concurrent.size ());
+                std::mutex print_mutex;
+                size_t next_to_print = 0;
+                Reporter& reporter = get_reporter ();
+                std::vector<T*> tests (concurrent);
+                tests.insert (tests.end (), sequential.begin (), sequential.end ());
+                open_fixtures (tests);
+
+                // Start and outcome events of concurrent tests are both emitted once the test's turn comes.
+                auto report = [&](size_t i)
                 {
-                    out () << f.get_error_message ();
+                    report_start (reporter, *concurrent[i], total - 1 - i);
+                    report_result (reporter, *concurrent[i], results[i], total - 1 - i);
+                };
+                std::vector<bool> batched (concurrent.size ());
+                run_async_batch (concurrent, results, batched, stop);
+                for (size_t i = 0; i < concurrent.size (); ++i)
+                    if (batched[i] && !results[i].ok && stop)
+                        cancelled = true;
+                WorkStealingPool pool (workers);
+                pool.run (concurrent.size (), [&](size_t i)
+                {
+                    TestResult& r = results[i];
+                    if (!batched[i])
+                        run_test (*concurrent[i], stop, r);
+                    if (!r.ok && stop)
+                        cancelled = true;
+                    std::lock_guard<std::mutex> lock (print_mutex);
+                    r.done = true;
+                    for (; next_to_print < results.size () && results[next_to_print].done; ++next_to_print)
+                        report (next_to_print);
+                }, cancelled);
+                for (; next_to_print < results.size (); ++next_to_print)
+                    report (next_to_print);
+
+                bool ok = true;
+                for (const TestResult& r : results)
+                    ok = ok && r.ok;
+
+                for (size_t i = 0; i < sequential.size (); ++i)
+                {
+                    TestResult r;
+                    if (!cancelled)
+                    {
+                        report_start (reporter, *sequential[i], sequential.size () - 1 - i);
+                        run_test (*sequential[i], stop, r);
+                    }
+                    report_result (reporter, *sequential[i], r, sequential.size () - 1 - i);
+                    ok = ok && r.ok;
+                    if (!r.ok && stop)
+                        cancelled = true;
                 }
+                close_fixtures (tests, &reporter);
                 return ok;
             }
 
-            size_t count () { return ordered_tests.size () + unordered_tests.size ();}
-            private:
-            UnorderedTestMap unordered_tests;
-            OrderedTestQueue ordered_tests;
+            static int64_t elapsed_since (std::chrono::steady_clock::time_point start)
+            {
+                return std::chrono::duration_cast<std::chrono::nanoseconds> (std::chrono::steady_clock::now () - start).count ();
+            }
+
+            std::vector<TestDescriptor> registry;
+            std::unordered_map<S, size_t> names;
+            size_t ordered_begin = 0;
+            bool sorted = true;
+            size_t workers = 1;
+            size_t repeat = 1;
+            bool shuffle = false;
+            uint64_t seed = 0;
+            Filter filter;
+            Reporter* reporter = nullptr;
             static Generator<CompositeTest> generator;
         };
 
-
-        extern CompositeTest& all_tests ();
-
-        #define CHECK(bool_expression, error_message)       \
-                                  check (bool_expression,   \
-                                 error_message,             \
-                                 __FILE__,                  \
-                                 __LINE__);
-
-
-        #define CHECK_EQ(T, actual, expected, error_message)   \
-                                  check_equal<T> (actual, expected,  \
-                                 error_message,             \
-                                 __FILE__,                  \
-                                 __LINE__);
-
-        #define CHECK_EQ_STR(actual, expected, error_message)   \
-                                  check_equal (actual, expected,  \
-                                 error_message,             \
-                                 __FILE__,                  \
-                                 __LINE__);
-
-        #define CHECK_NOT_EQ(T, actual, expected, error_message)   \
-                                  check_not_equal<T> (actual, expected,  \
-                                 error_message,             \
-                                 __FILE__,                  \
-                                 __LINE__);
-
-#define TEST_PREDICATE(name, bool_expression, error_message)        \
-                      class Test ## name : public Test\
-                      {                                            \
-                        public:                                    \
-                        inline static const Version VERSION = Version (1, 1, 1); \
-                        Test ## name ()                            \
-                        : Test (W(#name)){all_tests ().add(this);};             \
-                        bool run ()                                \
-                        {                                          \
-                          CHECK(bool_expression, error_message)    \
-                          return true;                             \
-                        }                                          \
-                      }; Test ## name test_ ## name;
-
-        #define TEST(name, is_enabled) \
-                      class Test##name : public Test               \
-                      {                                            \
-                        public:                                    \
-                        inline static const Version VERSION = Version (1, 1, 1); \
-                        Test##name ()                              \
-                        : Test (W(#name)){is_enabled ? enable () : disable ();all_tests ().add(this);};      \
-                        bool run ()                                \
-                        {
-
-        #define TEST_END(name)                                           \
-                        return true; }                             \
-                      }; Test ## name test_ ## name;
-
-        #define WCHECK(bool_expression, error_message)       \
-                                  check (bool_expression,   \
-                                 error_message,             \
-                                 __FILEW__,                  \
-                                 __LINE__);
-
-
-        #define WCHECK_EQ(T, actual, expected, error_message)   \
-                                  check_equal<T> (actual, expected,  \
-                                 error_message,             \
-                                 __FILEW__,                  \
-                                 __LINE__);
-
-        #define WCHECK_NOT_EQ(T, actual, expected, error_message)   \
-                                  check_not_equal<T> (actual, expected,  \
-                                 error_message,             \
-                                 __FILEW__,                  \
-                                 __LINE__);
-       
         inline Generator<CompositeTest> CompositeTest::generator = Generator<CompositeTest>();
-        inline Generator<Test> Test::generator = Generator<Test>();
 
+        /// The suite every TEST joins. Adopts the tests enlisted since the last call.
         inline CompositeTest& all_tests()
         {
             static CompositeTest* all = new CompositeTest(W("All tests"));
+            for (Test* t = Test::take_enlisted (); t != nullptr; t = t->get_next_enlisted ())
+                all->add (t);
             return *all;
         }
-            }  // namespace unit_test
- }  // namespace pensar_digital
+    }  // namespace unit_test
+}  // namespace pensar_digital
 
 #endif // TEST_HPP
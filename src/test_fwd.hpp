@@ -0,0 +1,654 @@
+#ifndef TEST_FWD_HPP
+#define TEST_FWD_HPP
+
+/// Declarations a test translation unit needs: Test, its checks and the TEST / CHECK macros.
+/// Tests include this header only. The runner (CompositeTest, reporters, thread pool, sharding),
+/// the vectorized range comparison and the formatting of failed checks are compiled once, into the
+/// unittest library (test.cpp), which a test executable links. Tests defined with the macros enlist
+/// themselves with Test::enlist (); all_tests () adopts them, so this header needs nothing from the
+/// runner. The opt-in instrumentation brings its own macros: include memory_usage.hpp for
+/// CHECK_MAX_ALLOCS / CHECK_NO_ALLOC and perf_counters.hpp for PERF_REGION.
+///
+/// The header is self-contained, so it can also be precompiled or, with C++20, imported as a
+/// header unit (import "test_fwd.hpp";), which keeps the macros available.
+
+#include "../../cpplib/src/constant.hpp"
+#include "../../cpplib/src/string_def.hpp"
+
+#include "../../cpplib/src/generator.hpp"
+#include "../../cpplib/src/macros.hpp"
+#include "../../cpplib//src/s.hpp"
+#include "../../cpplib/src/error.hpp"
+#include "../../cpplib/src/concept.hpp"
+#include "../../cpplib/src/stream_util.hpp"
+#include "../../cpplib/src/version.hpp"
+
+#include <string>
+#include <sstream>
+#include <concepts>
+#include <span>
+#include <source_location>
+#include <string_view>
+#include <cmath> // Added for std::abs
+#include <cstdint>
+#include <type_traits>
+#include <vector>
+
+namespace pensar_digital
+{
+    namespace pd = pensar_digital::cpplib;
+    namespace unit_test
+    {
+        using namespace cpplib;
+
+        const int UNORDERED = -1;
+
+        class FixtureBase;
+
+        /// Value types whose equality can be decided by comparing object representations.
+        template <typename T>
+        concept BitwiseComparable = std::is_trivially_copyable_v<T> && std::has_unique_object_representations_v<T>;
+
+        /// Element type of a contiguous container, as std::data exposes it.
+        template <typename R>
+        using ContiguousValue = std::remove_cvref_t<decltype (*std::data (std::declval<const R&> ()))>;
+
+        /// Pairs of contiguous ranges check_equal_collection compares with the vectorized kernels.
+        template <typename A, typename E>
+        concept ContiguousComparable =
+            requires (const A& a, const E& e) { std::data (a); std::size (a); std::data (e); std::size (e); } &&
+            std::same_as<ContiguousValue<A>, ContiguousValue<E>> &&
+            (BitwiseComparable<ContiguousValue<A>> || std::same_as<ContiguousValue<A>, float> || std::same_as<ContiguousValue<A>, double>);
+
+        /// Index of the first of n elements of elem_size bytes where a and b differ, or n when all are
+        /// equal. Vectorized with SSE2 / AVX2 where the CPU has them (range_compare.hpp, compiled into test.cpp).
+        size_t first_mismatch (const void* a, const void* b, size_t n, size_t elem_size);
+
+        /// Index of the first element where |a - b| < delta and |a - b| <= relative_delta * max (|a|, |b|)
+        /// both fail, or n when every element is within tolerance.
+        size_t first_outside (const float*  a, const float*  b, size_t n, float  delta, float  relative_delta);
+        size_t first_outside (const double* a, const double* b, size_t n, double delta, double relative_delta);
+
+        /// How a failed check_equal_range counts and prints its elements.
+        struct RangeElement
+        {
+            enum Kind : uint8_t { BYTES, FLOAT, DOUBLE };
+
+            size_t size;    ///< sizeof the element.
+            Kind   kind;    ///< BYTES elements are compared bitwise, FLOAT / DOUBLE with a tolerance.
+            /// Prints one element. nullptr prints its bytes in hex, as are single-byte elements.
+            void (*write) (std::basic_ostream<C>& os, const void* element);
+        };
+
+        /// Stream the current thread's test output goes to. The parallel runner points it at a
+        /// per-test buffer so lines written by concurrent tests do not interleave.
+        inline thread_local std::basic_ostream<C>* test_stream = nullptr;
+
+        inline std::basic_ostream<C>& test_out () { return test_stream == nullptr ? out () : *test_stream; }
+
+        /// Text argument of the check functions. A view, so string literals and existing strings
+        /// are passed without building a temporary std::basic_string.
+        typedef std::basic_string_view<C> Text;
+
+        /// Where a check was made. Holds views only, so the passing path never allocates; the file
+        /// name is materialized by get_file () when a check fails.
+        class Location
+        {
+            public:
+            Location (const std::source_location& where = std::source_location::current ()) :
+                source_file (where.file_name ()), line (where.line ()) {}
+
+            Location (Text afile, unsigned aline) : file (afile), line (aline) {}
+
+            S get_file () const
+            {
+                if (!file.empty ())
+                    return S (file);
+                return S (source_file.begin (), source_file.end ());
+            }
+
+            unsigned get_line () const { return line; }
+
+            private:
+            std::string_view source_file;
+            Text file;
+            unsigned line;
+        };
+
+        class Failure : Error
+        {
+            public:
+                //inline static const pd::Version::Ptr VERSION = pd::Version::get (1, 1, 1);
+            using Error::get_error_message;
+            Failure (const Id id,
+                     const std::basic_string<C>&     name,
+                     const std::basic_string<C>&     err_msg,
+                     const std::basic_string<C>&     afile,
+                     const unsigned    aline):
+                Error(err_msg, id),
+                test_id (id),
+                test_name (name),
+                file (afile),
+                line (aline)
+            {
+				SStream ss;
+				ss << file << W(" line \t") << line << W("\ttest_id = ") << id << W("\ttest_name = ") << name << W("\terror = ") << err_msg;
+				Error::set_error_message (ss.str ());
+            };
+
+            private:
+            const Id test_id;
+            const S test_name;
+            const S file;
+            const unsigned line;
+        };
+
+        /// Test is the interface to be implemented by all test classes..
+        class Test : public Object
+        {
+            private:
+                /// ID generator for tests.
+                static Generator<Test> generator;
+                int order;
+                bool stop_on_failure;
+                bool enabled;
+                S name;
+                const char* source_file;
+            public:
+                static constexpr double DEFAULT_DELTA = 0.0000001; // Added default delta
+                //inline static const Version::Ptr VERSION = pd::Version::get (1, 1, 1);
+                typedef Test T;
+
+            /// Constructor.
+            /// \param test_name The test name.
+            /// \param aid The test ID. One will be provided by default if you do not pass one.
+            /// \param where Where the test is defined. Defaults to the constructor's caller, which for the
+            ///              TEST macros is the test's own source file.
+                Test(const   S& test_name,
+                     const   Id       aid          =   NULL_ID,
+                            int       aorder       = UNORDERED,
+                           bool       stop_on_fail =      true,
+                           bool       is_enabled   = true,
+                     const std::source_location& where = std::source_location::current ()) :
+                order           (aorder      ),
+                stop_on_failure (stop_on_fail),
+                enabled         (is_enabled  ),
+                name            (test_name   ),
+                source_file     (where.file_name ()) {}
+
+            /// Virtual destructor.
+            virtual ~Test() {}
+
+            /// Tests run calling this method.
+            virtual bool run () = 0;
+
+            S get_name () const { return name; }
+			
+            void set_name (const S& a_name) { name = a_name; }
+
+            /// Source file the test is defined in, as the compiler spelled it.
+            const char* get_source_file () const { return source_file; }
+
+            /// Declares fixtures (see fixture.hpp) the test depends on. The runner sets them up before
+            /// the test and tears them down after the last test of the run depending on them. On a
+            /// CompositeTest it makes every test of the suite depend on them.
+            template <typename... F>
+            Test& uses (F&... f) { (fixtures.push_back (&f), ...); return *this; }
+
+            const std::vector<FixtureBase*>& get_fixtures () const { return fixtures; }
+
+            /// If expression is false and stop_on_failure = true throws a Failure exception.
+            bool check (bool expression, Text error_message, const Location& where = std::source_location::current ()) const
+            {
+                if (!expression) [[unlikely]]
+                    error<bool> (expression, true, error_message, where);
+                return expression;
+            }
+
+            template <OutputStreamable T> requires (!std::floating_point<T>)
+            bool check_equal (const T& actual, const T& expected, Text error_message, const Location& where = std::source_location::current ()) const
+            {
+                bool ok = (actual == expected);
+                if (!ok) [[unlikely]]
+                    error<T> (actual, expected, error_message, where);
+                return ok;
+            }
+
+            // Specialization for floating-point types
+            template <std::floating_point T>
+            bool check_equal (const T& actual, const T& expected, Text error_message, const Location& where = std::source_location::current (), double delta = DEFAULT_DELTA) const
+            {
+                bool ok = std::abs (actual - expected) < delta;
+                if (!ok) [[unlikely]]
+                    error<T> (actual, expected, S (error_message) + W(" (delta = ") + pd::to_string (delta) + W(")"), where);
+                return ok;
+            }
+
+            bool check_equal (const char* actual, const char* expected, Text error_message, const Location& where = std::source_location::current ()) const
+            {
+                bool ok = (strcmp (actual, expected) == 0);
+                if (!ok) [[unlikely]]
+                    error<std::string> (std::string (actual), std::string (expected), error_message, where);
+                return ok;
+            }
+
+            template <OutputStreamable T> requires (!std::floating_point<T>)
+            bool check_not_equal (const T& actual, const T& expected, Text error_message, const Location& where = std::source_location::current ()) const
+            {
+                bool ok = (actual != expected);
+                if (!ok) [[unlikely]]
+                    error<T> (actual, expected, error_message, where);
+                return ok;
+            }
+
+            // Specialization for floating-point types
+            template <std::floating_point T>
+            bool check_not_equal (const T& actual, const T& expected, Text error_message, const Location& where = std::source_location::current (), double delta = DEFAULT_DELTA) const
+            {
+                bool ok = std::abs (actual - expected) >= delta;
+                if (!ok) [[unlikely]]
+                    error<T> (actual, expected, S (error_message) + W(" (delta = ") + pd::to_string (delta) + W(")"), where);
+                return ok;
+            }
+
+            bool check_not_equal (const char* actual, const char* expected, Text error_message, const Location& where = std::source_location::current ()) const
+            {
+                bool ok = (strcmp (actual, expected) != 0);
+                if (!ok) [[unlikely]]
+                    error<std::string> (std::string (actual), std::string (expected), error_message, where);
+                return ok;
+            }
+
+            /// Compares sizes, then elements pairwise. Contiguous ranges of bitwise comparable or
+            /// floating-point elements are compared with vectorized kernels (see range_compare.hpp);
+            /// floating-point elements match when they differ by less than DEFAULT_DELTA. Otherwise the
+            /// message naming the failing index is only built once an element differs.
+            template <Container A, Container E>
+            bool check_equal_collection (const A& actual, const E& expected, Text error_message, const Location& where = std::source_location::current ()) const
+            {
+                bool ok = false;
+                try
+                {
+                    ok = check_size (actual.size (), expected.size (), error_message, where);
+                    if (!ok) [[unlikely]]
+                        return ok;
+
+                    if constexpr (ContiguousComparable<A, E>)
+                        return check_equal_range (std::data (actual), std::data (expected), actual.size (), DEFAULT_DELTA, 0.0, error_message, where);
+
+                    for (size_t i = 0; i < actual.size (); i++)
+                    {
+                        typename E::value_type const expected_value = expected[i];
+                        typename A::value_type const actual_value = actual[i];
+                        if (!equal (actual_value, static_cast<typename A::value_type> (expected_value))) [[unlikely]]
+                        {
+                            S err = S (error_message) + W(" at index ");
+                            err += pd::to_string<size_t, false> (i);
+                            ok = check_equal<typename A::value_type> (actual_value, expected_value, err, where);
+                        }
+                    }
+                    return ok;
+                }
+                catch (const Exception& e)
+                {
+                    ok = false;
+                    if (stop_on_failure)
+                        throw Failure (pd::Object::id (),
+                                       get_name (),
+                                       S (error_message) + e.what_error (), where.get_file (), where.get_line ());
+                }
+                return ok;
+            };
+
+            /// check_equal_collection for contiguous floating-point ranges with explicit tolerances:
+            /// elements match when |actual - expected| < delta or <= relative_delta * max (|actual|, |expected|).
+            template <Container A, Container E>
+                requires ContiguousComparable<A, E> && std::floating_point<ContiguousValue<A>>
+            bool check_near_collection (const A& actual, const E& expected, double delta, double relative_delta, Text error_message, const Location& where = std::source_location::current ()) const
+            {
+                if (!check_size (actual.size (), expected.size (), error_message, where)) [[unlikely]]
+                    return false;
+                return check_equal_range (std::data (actual), std::data (expected), actual.size (), delta, relative_delta, error_message, where);
+            }
+
+            // Overloads taking the file and line explicitly, for callers that pass __FILE__ / __LINE__.
+            bool check (bool expression, Text error_message, Text file, const unsigned line) const
+                { return check (expression, error_message, Location (file, line)); }
+
+            template <OutputStreamable T>
+            bool check_equal (const T& actual, const T& expected, Text error_message, Text file, const unsigned line) const
+                { return check_equal<T> (actual, expected, error_message, Location (file, line)); }
+
+            template <std::floating_point T>
+            bool check_equal (const T& actual, const T& expected, Text error_message, Text file, const unsigned line, double delta) const
+                { return check_equal<T> (actual, expected, error_message, Location (file, line), delta); }
+
+            bool check_equal (const char* actual, const char* expected, Text error_message, Text file, const unsigned line) const
+                { return check_equal (actual, expected, error_message, Location (file, line)); }
+
+            template <OutputStreamable T>
+            bool check_not_equal (const T& actual, const T& expected, Text error_message, Text file, const unsigned line) const
+                { return check_not_equal<T> (actual, expected, error_message, Location (file, line)); }
+
+            bool check_not_equal (const char* actual, const char* expected, Text error_message, Text file, const unsigned line) const
+                { return check_not_equal (actual, expected, error_message, Location (file, line)); }
+
+            template <Container A, Container E>
+            bool check_equal_collection (const A& actual, const E& expected, Text error_message, Text file, const unsigned line) const
+                { return check_equal_collection (actual, expected, error_message, Location (file, line)); }
+
+            /// Compares actual with the golden file at path without copying either (see golden.hpp). On
+            /// failure reports the first differing offset, its line and a window of bytes around it. In
+            /// update mode a missing or different golden file is rewritten with actual and the check passes.
+            /// Defined in test.cpp, which keeps the file mapping and <filesystem> out of test translation units.
+            bool check_golden (std::span<const std::byte> actual, std::string_view  path, Text error_message, const Location& where = std::source_location::current ()) const;
+            bool check_golden (std::span<const std::byte> actual, std::wstring_view path, Text error_message, const Location& where = std::source_location::current ()) const;
+
+            /// check_golden for a std::filesystem::path, or any path type exposing native ().
+            template <typename Path> requires requires (const Path& p) { p.native (); }
+            bool check_golden (std::span<const std::byte> actual, const Path& path, Text error_message, const Location& where = std::source_location::current ()) const
+                { return check_golden (actual, path.native (), error_message, where); }
+
+            /// Prints the mismatch and, if stop_on_failure = true, throws a Failure. Only reached when a check fails.
+            template <OutputStreamable T>
+            void error (const T& actual, const T& expected, Text error_message, const Location& where) const
+            {
+                SStream detail;
+                if constexpr (std::is_same_v<T, std::string>)
+                {
+                    #ifdef WIDE_CHAR
+                        detail << W("\t actual [") << to_wstring (actual) << W("] != [") << to_wstring (expected) << W("] expected");
+                    #else
+                        detail << W("\t actual [") << actual << W("] != [") << expected << W("] expected");
+                    #endif
+                }
+                else
+                    detail << W("\t actual [") << actual << W("] != [") << expected << W("] expected");
+                fail (detail.str (), error_message, where);
+            }
+
+            template <OutputStreamable T>
+            void error (const T& actual, const T& expected, Text error_message, Text file, const unsigned line) const
+                { error<T> (actual, expected, error_message, Location (file, line)); }
+
+            /// Writes a failed check's line to the test output: where, detail and error_message. Then, if
+            /// stop_on_failure = true, throws a Failure whose message is error_message followed by suffix.
+            void fail (Text detail, Text error_message, const Location& where, Text suffix = Text ()) const;
+
+            private:
+            template <typename T>
+            static bool equal (const T& actual, const T& expected)
+            {
+                if constexpr (std::floating_point<T>)
+                    return std::abs (actual - expected) < DEFAULT_DELTA;
+                else
+                    return actual == expected;
+            }
+
+            bool check_size (size_t actual, size_t expected, Text error_message, const Location& where) const
+            {
+                if (actual == expected) [[likely]]
+                    return true;
+                SStream detail;
+                detail << W("\t actual size [") << actual << W("] != [") << expected << W("] expected size");
+                fail (detail.str (), error_message, where);
+                return false;
+            }
+
+            /// Finds the first of n elements that differ. The comparison is vectorized and the failure is
+            /// reported by range_mismatch; both are compiled into test.cpp.
+            template <typename T>
+            bool check_equal_range (const T* actual, const T* expected, size_t n, double delta, double relative_delta, Text error_message, const Location& where) const
+            {
+                size_t first;
+                if constexpr (std::floating_point<T>)
+                    first = first_outside (actual, expected, n, static_cast<T> (delta), static_cast<T> (relative_delta));
+                else
+                    first = first_mismatch (actual, expected, n, sizeof (T));
+                if (first == n) [[likely]]
+                    return true;
+                return range_mismatch (actual, expected, n, first, range_element<T> (), delta, relative_delta, error_message, where);
+            }
+
+            /// Reports the first mismatch of a range at first, the number of differing elements and a
+            /// window of up to WINDOW elements on each side of it. Returns false.
+            bool range_mismatch (const void* actual, const void* expected, size_t n, size_t first, const RangeElement& element,
+                                 double delta, double relative_delta, Text error_message, const Location& where) const;
+
+            /// The body of check_golden, for either width of path name.
+            template <typename Char>
+            bool check_golden_file (std::span<const std::byte> actual, std::basic_string_view<Char> path, Text error_message, const Location& where) const;
+
+            static constexpr size_t WINDOW = 8;
+
+            /// Writes the elements around first, with first in brackets.
+            static void write_window (std::basic_ostream<C>& os, const C* label, const void* values, size_t n, size_t first, const RangeElement& element);
+
+            template <typename T>
+            static void write_element (std::basic_ostream<C>& os, const void* element) { os << *static_cast<const T*> (element); }
+
+            template <typename T>
+            static constexpr RangeElement range_element ()
+            {
+                if constexpr (std::same_as<T, float>)
+                    return { sizeof (T), RangeElement::FLOAT, nullptr };
+                else if constexpr (std::same_as<T, double>)
+                    return { sizeof (T), RangeElement::DOUBLE, nullptr };
+                else if constexpr (sizeof (T) > 1 && OutputStreamable<T>)
+                    return { sizeof (T), RangeElement::BYTES, &write_element<T> };
+                else
+                    return { sizeof (T), RangeElement::BYTES, nullptr };
+            }
+
+            public:
+            int           get_order          () const { return order;             }
+            bool          get_stop_on_failure() const { return stop_on_failure;   }
+            bool          is_enabled         () const { return enabled;           }
+            bool          is_ordered         () const { return order != UNORDERED;}
+
+            Test& enable () { enabled = true ; return *this; }
+            Test& disable() { enabled = false; return *this; }
+
+            Test& set_stop_on_failure ( bool Stop         ) { stop_on_failure = Stop; return *this; }
+
+            /// Queues the test for all_tests (), which adopts queued tests, in order, whenever it is
+            /// called. The TEST macros call this from the test's constructor.
+            void enlist ()
+            {
+                *last_enlisted = this;
+                last_enlisted = &next_enlisted;
+            }
+
+            /// Detaches the queue of enlisted tests and returns its first test.
+            static Test* take_enlisted ()
+            {
+                Test* first = first_enlisted;
+                first_enlisted = nullptr;
+                last_enlisted = &first_enlisted;
+                return first;
+            }
+
+            Test* get_next_enlisted () const { return next_enlisted; }
+
+            bool operator==  (const T& t) const { return pd::Object::id () == t.id ();}
+            bool operator<   (const T& t) const { return order < t.order;       }
+            bool operator!=  (const T& t) const { return !(*this == t);          }
+
+            virtual std::istream& read (std::istream& is, const std::endian& byte_order = std::endian::native)
+            {
+                return is;
+            }
+
+            virtual std::ostream& write (std::ostream& os, const std::endian& byte_order = std::endian::native) const
+            {
+                return os;
+            }
+
+            private:
+            std::vector<FixtureBase*> fixtures;
+            Test* next_enlisted = nullptr;
+            inline static Test*  first_enlisted = nullptr;
+            inline static Test** last_enlisted  = &first_enlisted;
+        };
+
+        /// Reached only while a CONSTEXPR_TEST is constant-evaluated and one of its checks fails. It is
+        /// not constexpr, so the static_assert fails and the compiler's notes name this function and
+        /// the CHECK line that called it.
+        inline void CHECK_failed_at_compile_time ([[maybe_unused]] Text error_message, [[maybe_unused]] const std::source_location& where) {}
+
+        /// The check functions of Test, for constant evaluation. CONSTEXPR_TEST bodies run against
+        /// these in a static_assert and, when registered at run time, against Test's.
+        struct CompileTimeChecks
+        {
+            constexpr bool check (bool expression, Text error_message, const std::source_location& where = std::source_location::current ()) const
+            {
+                if (!expression)
+                    CHECK_failed_at_compile_time (error_message, where);
+                return expression;
+            }
+
+            template <typename T> requires (!std::floating_point<T>)
+            constexpr bool check_equal (const T& actual, const T& expected, Text error_message, const std::source_location& where = std::source_location::current ()) const
+                { return check (actual == expected, error_message, where); }
+
+            template <std::floating_point T>
+            constexpr bool check_equal (const T& actual, const T& expected, Text error_message, const std::source_location& where = std::source_location::current (), double delta = Test::DEFAULT_DELTA) const
+                { return check ((actual < expected ? expected - actual : actual - expected) < delta, error_message, where); }
+
+            template <typename Char>
+            constexpr bool check_equal (const Char* actual, const Char* expected, Text error_message, const std::source_location& where = std::source_location::current ()) const
+                { return check (std::basic_string_view<Char> (actual) == std::basic_string_view<Char> (expected), error_message, where); }
+
+            template <typename T> requires (!std::floating_point<T>)
+            constexpr bool check_not_equal (const T& actual, const T& expected, Text error_message, const std::source_location& where = std::source_location::current ()) const
+                { return check (!(actual == expected), error_message, where); }
+
+            template <std::floating_point T>
+            constexpr bool check_not_equal (const T& actual, const T& expected, Text error_message, const std::source_location& where = std::source_location::current (), double delta = Test::DEFAULT_DELTA) const
+                { return check ((actual < expected ? expected - actual : actual - expected) >= delta, error_message, where); }
+        };
+
+        // The check macros record their location through std::source_location, so a passing check
+        // builds no strings at all. They name this-> explicitly so they also work in CONSTEXPR_TEST
+        // bodies, where the checks come from a dependent base.
+        #define CHECK(bool_expression, error_message)       \
+                                  this->check (bool_expression,   \
+                                 error_message);
+
+        #define CHECK_EQ(T, actual, expected, error_message)   \
+                                  this->template check_equal<T> (actual, expected,  \
+                                 error_message);
+
+        #define CHECK_EQ_STR(actual, expected, error_message)   \
+                                  this->check_equal (actual, expected,  \
+                                 error_message);
+
+        #define CHECK_NOT_EQ(T, actual, expected, error_message)   \
+                                  this->template check_not_equal<T> (actual, expected,  \
+                                 error_message);
+
+        /// CHECK_MATCHES_GOLDEN(path, bytes, error_message) compares a contiguous range, e.g. a std::string
+        /// or std::vector<std::byte>, with the golden file at path. Run with --update-golden to rewrite it.
+        #define CHECK_MATCHES_GOLDEN(path, bytes, error_message)   \
+                                  this->check_golden (std::as_bytes (std::span (bytes)), path,  \
+                                 error_message);
+
+#define TEST_PREDICATE(name, bool_expression, error_message)        \
+                      class Test ## name : public Test\
+                      {                                            \
+                        public:                                    \
+                        inline static const Version VERSION = Version (1, 1, 1); \
+                        Test ## name ()                            \
+                        : Test (W(#name)){enlist ();};                            \
+                        bool run ()                                \
+                        {                                          \
+                          CHECK(bool_expression, error_message)    \
+                          return true;                             \
+                        }                                          \
+                      }; Test ## name test_ ## name;
+
+        #define TEST(name, is_enabled) \
+                      class Test##name : public Test               \
+                      {                                            \
+                        public:                                    \
+                        inline static const Version VERSION = Version (1, 1, 1); \
+                        Test##name ()                              \
+                        : Test (W(#name)){is_enabled ? enable () : disable ();enlist ();};              \
+                        bool run ()                                \
+                        {
+
+        /// TEST_WITH(name, is_enabled, fixture, ...) is TEST with the fixtures the test uses.
+        #define TEST_WITH(name, is_enabled, ...) \
+                      class Test##name : public Test               \
+                      {                                            \
+                        public:                                    \
+                        inline static const Version VERSION = Version (1, 1, 1); \
+                        Test##name ()                              \
+                        : Test (W(#name)){is_enabled ? enable () : disable ();uses (__VA_ARGS__);enlist ();}; \
+                        bool run ()                                \
+                        {
+
+        #define TEST_END(name)                                           \
+                        return true; }                             \
+                      }; Test ## name test_ ## name;
+
+        /// Whether CONSTEXPR_TESTs also register as run-time tests: by default in debug builds
+        /// (no NDEBUG) and in coverage builds (UNIT_TEST_COVERAGE), where their lines should count.
+        #ifndef UNIT_TEST_CONSTEXPR_AT_RUNTIME
+            #if !defined(NDEBUG) || defined(UNIT_TEST_COVERAGE)
+                #define UNIT_TEST_CONSTEXPR_AT_RUNTIME 1
+            #else
+                #define UNIT_TEST_CONSTEXPR_AT_RUNTIME 0
+            #endif
+        #endif
+
+        #if UNIT_TEST_CONSTEXPR_AT_RUNTIME
+            #define UNIT_TEST_CONSTEXPR_REGISTER(name)                                   \
+                      class Test##name : public ConstexprTest##name<Test>                  \
+                      {                                                                   \
+                        public:                                                           \
+                        inline static const Version VERSION = Version (1, 1, 1);          \
+                        Test##name ()                                                     \
+                        : ConstexprTest##name<Test> (W(#name)){enlist ();};               \
+                        bool run () { return body (); }                                   \
+                      }; Test##name test_##name;
+        #else
+            #define UNIT_TEST_CONSTEXPR_REGISTER(name)
+        #endif
+
+        /// CONSTEXPR_TEST(name) ... CONSTEXPR_TEST_END(name) is a test whose body must be constant-
+        /// evaluable. It is run at compile time by a static_assert, a failing CHECK* being a compile
+        /// error, and registered in all_tests () as a normal test when UNIT_TEST_CONSTEXPR_AT_RUNTIME.
+        /// The body may use CHECK, CHECK_EQ, CHECK_EQ_STR and CHECK_NOT_EQ.
+        #define CONSTEXPR_TEST(name)                                                      \
+                      template <typename Checks>                                          \
+                      class ConstexprTest##name : public Checks                           \
+                      {                                                                   \
+                        public:                                                           \
+                        using Checks::Checks;                                             \
+                        constexpr bool body ()                                            \
+                        {
+
+        #define CONSTEXPR_TEST_END(name)                                                  \
+                        return true; }                                                    \
+                      };                                                                  \
+                      static_assert (ConstexprTest##name<CompileTimeChecks> ().body (),   \
+                                     "CONSTEXPR_TEST " #name " failed at compile time.");  \
+                      UNIT_TEST_CONSTEXPR_REGISTER(name)
+
+        #define WCHECK(bool_expression, error_message) CHECK(bool_expression, error_message)
+
+        #define WCHECK_EQ(T, actual, expected, error_message) CHECK_EQ(T, actual, expected, error_message)
+
+        #define WCHECK_NOT_EQ(T, actual, expected, error_message) CHECK_NOT_EQ(T, actual, expected, error_message)
+
+        inline Generator<Test> Test::generator = Generator<Test>();
+
+        /// Runs all_tests () with the command line options of CompositeTest::parse_arguments. Returns
+        /// the process exit code. Defined in the unittest library (test.cpp), so a test executable
+        /// linking it needs no more than this header and a main calling it.
+        int run_tests (int argc, const char* const argv[]);
+    }  // namespace unit_test
+}  // namespace pensar_digital
+
+#endif // TEST_FWD_HPP
@@ -0,0 +1,99 @@
+#ifndef THREAD_POOL_HPP
+#define THREAD_POOL_HPP
+
+#include <atomic>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace pensar_digital
+{
+    namespace unit_test
+    {
+        /// WorkStealingPool runs a batch of indexed jobs on a fixed number of threads.
+        /// Each worker owns a deque. It pops from the front of its own deque and, when
+        /// that is empty, steals from the back of the other workers' deques.
+        class WorkStealingPool
+        {
+            public:
+            typedef std::function<void (size_t)> Job;
+
+            /// \param worker_count Number of threads. 0 means one per hardware thread.
+            explicit WorkStealingPool (size_t worker_count = 0) :
+                workers (worker_count == 0 ? default_worker_count () : worker_count) {}
+
+            static size_t default_worker_count ()
+            {
+                size_t n = std::thread::hardware_concurrency ();
+                return n == 0 ? 1 : n;
+            }
+
+            size_t get_workers () const { return workers; }
+
+            /// Runs job (i) for every i in [0, job_count) and returns when all jobs have finished.
+            /// Jobs not yet started when cancelled becomes true are skipped.
+            void run (size_t job_count, const Job& job, const std::atomic<bool>& cancelled)
+            {
+                size_t n = workers < job_count ? workers : job_count;
+                if (n == 0)
+                    return;
+                std::vector<Queue> queues (n);
+                for (size_t i = 0; i < job_count; ++i)
+                    queues[i % n].jobs.push_back (i);
+
+                std::vector<std::thread> threads;
+                threads.reserve (n);
+                for (size_t w = 0; w < n; ++w)
+                {
+                    threads.emplace_back ([&queues, &job, &cancelled, w, n]()
+                    {
+                        size_t i;
+                        while (!cancelled.load (std::memory_order_relaxed) && next (queues, w, n, i))
+                            job (i);
+                    });
+                }
+                for (std::thread& t : threads)
+                    t.join ();
+            }
+
+            private:
+            struct Queue
+            {
+                std::mutex mutex;
+                std::deque<size_t> jobs;
+            };
+
+            /// Takes the next job for worker w, stealing from the other queues when its own is empty.
+            static bool next (std::vector<Queue>& queues, size_t w, size_t n, size_t& i)
+            {
+                {
+                    std::lock_guard<std::mutex> lock (queues[w].mutex);
+                    if (!queues[w].jobs.empty ())
+                    {
+                        i = queues[w].jobs.front ();
+                        queues[w].jobs.pop_front ();
+                        return true;
+                    }
+                }
+                for (size_t k = 1; k < n; ++k)
+                {
+                    Queue& victim = queues[(w + k) % n];
+                    std::lock_guard<std::mutex> lock (victim.mutex);
+                    if (!victim.jobs.empty ())
+                    {
+                        i = victim.jobs.back ();
+                        victim.jobs.pop_back ();
+                        return true;
+                    }
+                }
+                return false;
+            }
+
+            size_t workers;
+        };
+    }  // namespace unit_test
+}  // namespace pensar_digital
+
+#endif // THREAD_POOL_HPP
@@ -0,0 +1,124 @@
+// author : Mauricio Gomes
+// license: MIT (https://opensource.org/licenses/MIT)
+
+// Tests of the timing history: the binary file format of TimingHistory, including the recovery
+// from an interrupted append, and the Mann-Whitney test of the regression gate.
+
+#include "../src/history.hpp"
+
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <vector>
+
+namespace pensar_digital
+{
+    namespace unit_test
+    {
+        /// A file in the temporary directory, removed before and after the test.
+        struct TemporaryFile
+        {
+            explicit TemporaryFile (const char* name) : path (std::filesystem::temp_directory_path () / name) { std::filesystem::remove (path); }
+            ~TemporaryFile () { std::error_code ignored; std::filesystem::remove (path, ignored); }
+
+            std::filesystem::path path;
+        };
+
+        inline HistoryRun history_run (int64_t timestamp, int64_t nanoseconds)
+        {
+            HistoryRun run;
+            run.timestamp = timestamp;
+            run.entries.push_back (HistoryEntry { 1, W("Alpha"), nanoseconds, true, {} });
+            HistoryEntry failed { 2, W("Beta"), 2 * nanoseconds, false, {} };
+            failed.perf.available = (1u << PerfCounters::CYCLES) | (1u << PerfCounters::LLC_MISSES);
+            failed.perf.values[PerfCounters::CYCLES] = 123456789;
+            failed.perf.values[PerfCounters::LLC_MISSES] = 42;
+            run.entries.push_back (failed);
+            return run;
+        }
+
+        inline bool same_run (const HistoryRun& a, const HistoryRun& b)
+        {
+            if (a.timestamp != b.timestamp || a.entries.size () != b.entries.size ())
+                return false;
+            for (size_t i = 0; i < a.entries.size (); ++i)
+            {
+                const HistoryEntry& x = a.entries[i];
+                const HistoryEntry& y = b.entries[i];
+                if (x.id != y.id || x.name != y.name || x.nanoseconds != y.nanoseconds || x.ok != y.ok || x.perf.available != y.perf.available)
+                    return false;
+                for (uint8_t k = 0; k < PerfCounters::EVENT_COUNT; ++k)
+                    if (x.perf.values[k] != y.perf.values[k])
+                        return false;
+            }
+            return true;
+        }
+
+        TEST(TimingHistoryRoundTrip, true)
+            TemporaryFile file ("unit_test_history_round_trip.bin");
+            CHECK(TimingHistory::load (file.path).empty (), W("missing file"))
+            CHECK_EQ(uintmax_t, TimingHistory::valid_size (file.path), 0, W("missing file size"))
+            const HistoryRun runs[] = { history_run (1000, 10), history_run (2000, 20), history_run (3000, 30) };
+            for (const HistoryRun& run : runs)
+                TimingHistory::append (file.path, run);
+            std::vector<HistoryRun> loaded = TimingHistory::load (file.path);
+            CHECK_EQ(size_t, loaded.size (), 3, W("run count"))
+            for (size_t i = 0; i < loaded.size () && i < 3; ++i)
+                CHECK(same_run (loaded[i], runs[i]), W("run read back as written"))
+            loaded = TimingHistory::load (file.path, 2);
+            CHECK_EQ(size_t, loaded.size (), 2, W("last runs only"))
+            CHECK(loaded.size () == 2 && same_run (loaded[0], runs[1]) && same_run (loaded[1], runs[2]), W("last runs, oldest first"))
+            CHECK_EQ(uintmax_t, TimingHistory::valid_size (file.path), std::filesystem::file_size (file.path), W("complete file is valid"))
+        TEST_END(TimingHistoryRoundTrip)
+
+        TEST(TimingHistoryTruncatedTail, true)
+            TemporaryFile file ("unit_test_history_truncated.bin");
+            TimingHistory::append (file.path, history_run (1000, 10));
+            const uintmax_t one_run = std::filesystem::file_size (file.path);
+            TimingHistory::append (file.path, history_run (2000, 20));
+            const uintmax_t two_runs = std::filesystem::file_size (file.path);
+            for (uintmax_t cut : { two_runs - 1, one_run + 12, one_run + 4, one_run + 1 })
+            {
+                std::filesystem::resize_file (file.path, cut);
+                CHECK_EQ(uintmax_t, TimingHistory::valid_size (file.path), one_run, W("valid size stops at the last complete record"))
+                std::vector<HistoryRun> loaded = TimingHistory::load (file.path);
+                CHECK(loaded.size () == 1 && same_run (loaded[0], history_run (1000, 10)), W("truncated record is not loaded"))
+            }
+            TimingHistory::append (file.path, history_run (3000, 30));
+            CHECK_EQ(uintmax_t, std::filesystem::file_size (file.path), two_runs, W("append cuts off the truncated record"))
+            std::vector<HistoryRun> loaded = TimingHistory::load (file.path);
+            CHECK(loaded.size () == 2 && same_run (loaded[0], history_run (1000, 10)) && same_run (loaded[1], history_run (3000, 30)),
+                  W("run appended after the truncated record"))
+        TEST_END(TimingHistoryTruncatedTail)
+
+        TEST(TimingHistoryNotAHistory, true)
+            TemporaryFile file ("unit_test_history_not_a_history.bin");
+            std::ofstream (file.path) << "not a history\n";
+            bool thrown = false;
+            try
+            {
+                TimingHistory::append (file.path, history_run (1000, 10));
+            }
+            catch (const std::runtime_error&)
+            {
+                thrown = true;
+            }
+            CHECK(thrown, W("append refuses a file that is not a history"))
+            CHECK_EQ(uintmax_t, std::filesystem::file_size (file.path), 14, W("file left untouched"))
+            CHECK(TimingHistory::load (file.path).empty (), W("nothing loaded"))
+        TEST_END(TimingHistoryNotAHistory)
+
+        // Expected p-values of the one-sided test with normal approximation, continuity and tie
+        // corrections, as R's wilcox.test (a, b, alternative = "greater", exact = FALSE) gives them.
+        // Samples with no spread or no values give 1.
+        TEST(MannWhitneyGreater, true)
+            CHECK_EQ(double, mann_whitney_greater ({ 6, 7, 8, 9, 10 }, { 1, 2, 3, 4, 5 }), 0.0060928902, W("no overlap, U = 25"))
+            CHECK_EQ(double, mann_whitney_greater ({ 7, 8, 9, 10, 11, 12 }, { 1, 2, 3, 4, 5, 6 }), 0.0025374340, W("no overlap, U = 36"))
+            CHECK_EQ(double, mann_whitney_greater ({ 1, 2, 3 }, { 4, 5, 6 }), 0.9854518341, W("wrong direction"))
+            CHECK_EQ(double, mann_whitney_greater ({ 6, 7, 8, 9, 10, 11 }, { 1, 2, 3, 4, 5, 6 }), 0.0031961344, W("one tie"))
+            CHECK_EQ(double, mann_whitney_greater ({ 3, 4, 4, 5, 6 }, { 1, 2, 3, 3, 4 }), 0.0269684710, W("two groups of three ties"))
+            CHECK_EQ(double, mann_whitney_greater ({ 5, 5, 5 }, { 5, 5, 5 }), 1.0, W("all tied"))
+            CHECK_EQ(double, mann_whitney_greater ({}, { 1, 2, 3 }), 1.0, W("empty sample"))
+        TEST_END(MannWhitneyGreater)
+    }  // namespace unit_test
+}  // namespace pensar_digital
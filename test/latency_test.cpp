@@ -0,0 +1,103 @@
+// author : Mauricio Gomes
+// license: MIT (https://opensource.org/licenses/MIT)
+
+// Tests of LatencyHistogram: the bucket index math, seen through percentile (), values above the
+// trackable range and the coordinated-omission correction.
+
+#include "../src/latency.hpp"
+
+#include <cstdint>
+#include <vector>
+
+namespace pensar_digital
+{
+    namespace unit_test
+    {
+        /// Records each of values once; percentile i - 0.5 of n then falls in the bucket of the i-th.
+        inline std::vector<uint64_t> equivalents (LatencyHistogram& h, const std::vector<uint64_t>& values)
+        {
+            for (uint64_t value : values)
+                h.record (value);
+            std::vector<uint64_t> result;
+            for (size_t i = 1; i <= values.size (); ++i)
+                result.push_back (h.percentile (100.0 * (i - 0.5) / values.size ()));
+            return result;
+        }
+
+        TEST(LatencyHistogramPrecision, true)
+            const uint64_t highest = 10000000000ull;
+            std::vector<uint64_t> values;
+            for (uint64_t value = 1; value < highest; value = value * 3 / 2 + 1)
+                values.push_back (value);
+            for (unsigned digits = 1; digits <= 5; ++digits)
+            {
+                uint64_t resolution = 1;
+                for (unsigned i = 0; i < digits; ++i)
+                    resolution *= 10;
+                LatencyHistogram h (highest, digits);
+                std::vector<uint64_t> p = equivalents (h, values);
+                for (size_t i = 0; i < values.size (); ++i)
+                {
+                    CHECK(p[i] >= values[i], W("percentile below the recorded value"))
+                    CHECK(p[i] - values[i] <= values[i] / resolution, W("percentile outside the significant digits"))
+                }
+            }
+            std::vector<uint64_t> small;
+            for (uint64_t value = 1; value <= 2048; ++value)
+                small.push_back (value);
+            LatencyHistogram h (highest, 3);
+            CHECK(equivalents (h, small) == small, W("values below the first bucket's range are exact"))
+        TEST_END(LatencyHistogramPrecision)
+
+        TEST(LatencyHistogramPercentiles, true)
+            LatencyHistogram h;
+            CHECK_EQ(uint64_t, h.percentile (50), 0, W("empty histogram"))
+            for (uint64_t value = 1; value <= 1000; ++value)
+                h.record (value * 1000);
+            CHECK_EQ(uint64_t, h.count (), 1000, W("count"))
+            CHECK_EQ(uint64_t, h.min (), 1000, W("min"))
+            CHECK_EQ(uint64_t, h.max (), 1000000, W("max"))
+            CHECK_EQ(uint64_t, static_cast<uint64_t> (h.mean ()), 500500, W("mean"))
+            const double percentiles[] = { 0, 10, 50, 90, 99, 99.9, 100 };
+            const uint64_t expected[]  = { 1000, 100000, 500000, 900000, 990000, 999000, 1000000 };
+            for (size_t i = 0; i < 7; ++i)
+            {
+                uint64_t p = h.percentile (percentiles[i]);
+                CHECK(p >= expected[i] && p - expected[i] <= expected[i] / 1000, W("percentile of 1..1000 us"))
+            }
+            h.reset ();
+            CHECK_EQ(uint64_t, h.count (), 0, W("count after reset"))
+            CHECK_EQ(uint64_t, h.percentile (99), 0, W("percentile after reset"))
+        TEST_END(LatencyHistogramPercentiles)
+
+        TEST(LatencyHistogramAboveHighest, true)
+            const uint64_t highest = 1000000;
+            LatencyHistogram h (highest, 3);
+            h.record (10);
+            h.record (5000000000ull);
+            h.record (UINT64_MAX / 2);
+            CHECK_EQ(uint64_t, h.count (), 3, W("values above highest are counted"))
+            CHECK_EQ(uint64_t, h.max (), UINT64_MAX / 2, W("max keeps the largest value recorded"))
+            CHECK_EQ(uint64_t, h.percentile (10), 10, W("smallest value"))
+            uint64_t p = h.percentile (100);
+            CHECK(p >= highest && p - highest <= highest / 1000, W("values above highest are counted as highest"))
+        TEST_END(LatencyHistogramAboveHighest)
+
+        TEST(LatencyHistogramCorrected, true)
+            LatencyHistogram h;
+            h.record_corrected (1000, 100);
+            CHECK_EQ(uint64_t, h.count (), 10, W("a stall of 10 intervals adds the 9 samples it delayed"))
+            CHECK_EQ(uint64_t, h.min (), 100, W("the last missing sample is one interval"))
+            CHECK_EQ(uint64_t, h.max (), 1000, W("the stall itself"))
+            h.reset ();
+            h.record_corrected (1050, 100);
+            CHECK_EQ(uint64_t, h.count (), 10, W("partial interval"))
+            CHECK_EQ(uint64_t, h.min (), 150, W("partial interval min"))
+            h.reset ();
+            h.record_corrected (100, 100);
+            h.record_corrected (50, 100);
+            h.record_corrected (1000, 0);
+            CHECK_EQ(uint64_t, h.count (), 3, W("no correction within the interval or without one"))
+        TEST_END(LatencyHistogramCorrected)
+    }  // namespace unit_test
+}  // namespace pensar_digital